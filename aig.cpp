@@ -0,0 +1,566 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <queue>
+#include <unordered_map>
+#include "aig.hpp"
+#include "semantics.hpp"
+
+namespace {
+
+// A literal is 2 * node + complement. Node 0 is constant false, so literal 0
+// is false and literal 1 is true.
+using Lit = uint32_t;
+
+inline Lit litOf(uint32_t node, bool neg = false) { return node * 2 + (neg ? 1 : 0); }
+inline uint32_t nodeOf(Lit l) { return l >> 1; }
+inline bool isNeg(Lit l) { return (l & 1) != 0; }
+
+enum class Kind : uint8_t { Const, Input, And, Xor };
+
+struct Node {
+    Lit f0, f1;
+    Kind kind;
+};
+
+// Structurally hashed AND/XOR graph. XOR fanins are never complemented: the
+// complement is moved to the output, so x ^ ~y and ~x ^ y share a node.
+class Aig {
+public:
+    std::vector<Node> nodes;
+    std::vector<int> level;
+    int inputs = 0;
+
+    Aig() {
+        nodes.push_back({0, 0, Kind::Const});
+        level.push_back(0);
+    }
+
+    Lit input() {
+        nodes.push_back({0, 0, Kind::Input});
+        level.push_back(0);
+        ++inputs;
+        return litOf(static_cast<uint32_t>(nodes.size() - 1));
+    }
+
+    Lit mkAnd(Lit a, Lit b) {
+        if (a > b) std::swap(a, b);
+        if (a == 0) return 0;
+        if (a == 1) return b;
+        if (a == b) return a;
+        if ((a ^ b) == 1) return 0;
+        return add(Kind::And, a, b);
+    }
+
+    Lit mkOr(Lit a, Lit b) { return mkAnd(a ^ 1, b ^ 1) ^ 1; }
+
+    Lit mkXor(Lit a, Lit b) {
+        Lit c = (a ^ b) & 1;
+        a &= ~1u;
+        b &= ~1u;
+        if (a > b) std::swap(a, b);
+        if (a == b) return c;
+        if (a == 0) return b ^ c;
+        return add(Kind::Xor, a, b) ^ c;
+    }
+
+    Lit make(Kind kind, Lit a, Lit b) { return kind == Kind::And ? mkAnd(a, b) : mkXor(a, b); }
+
+    size_t size() const { return nodes.size(); }
+
+    // Drops every node from mark onwards.
+    void truncate(size_t mark) {
+        for (size_t i = mark; i < nodes.size(); ++i) {
+            const Node& n = nodes[i];
+            auto& table = n.kind == Kind::And ? ands : xors;
+            auto it = table.find(key(n.f0, n.f1));
+            if (it != table.end() && it->second == i) table.erase(it);
+        }
+        nodes.resize(mark);
+        level.resize(mark);
+    }
+
+private:
+    std::unordered_map<uint64_t, uint32_t> ands, xors;
+
+    static uint64_t key(Lit a, Lit b) { return (static_cast<uint64_t>(a) << 32) | b; }
+
+    Lit add(Kind kind, Lit a, Lit b) {
+        auto& table = kind == Kind::And ? ands : xors;
+        auto it = table.find(key(a, b));
+        if (it != table.end()) return litOf(it->second);
+        uint32_t n = static_cast<uint32_t>(nodes.size());
+        nodes.push_back({a, b, kind});
+        level.push_back(1 + std::max(level[nodeOf(a)], level[nodeOf(b)]));
+        table.emplace(key(a, b), n);
+        return litOf(n);
+    }
+};
+
+bool isGateNode(const Node& n) { return n.kind == Kind::And || n.kind == Kind::Xor; }
+
+std::vector<char> liveNodes(const Aig& g, const std::vector<Lit>& outs) {
+    std::vector<char> live(g.size(), 0);
+    for (Lit o : outs) live[nodeOf(o)] = 1;
+    for (size_t i = g.size(); i-- > 1;) {
+        if (!live[i] || !isGateNode(g.nodes[i])) continue;
+        live[nodeOf(g.nodes[i].f0)] = 1;
+        live[nodeOf(g.nodes[i].f1)] = 1;
+    }
+    return live;
+}
+
+int gateCount(const Aig& g, const std::vector<Lit>& outs) {
+    std::vector<char> live = liveNodes(g, outs);
+    int count = 0;
+    for (size_t i = 0; i < g.size(); ++i)
+        if (live[i] && isGateNode(g.nodes[i])) ++count;
+    return count;
+}
+
+std::vector<int> fanoutCounts(const Aig& g, const std::vector<Lit>& outs) {
+    std::vector<char> live = liveNodes(g, outs);
+    std::vector<int> refs(g.size(), 0);
+    for (Lit o : outs) ++refs[nodeOf(o)];
+    for (size_t i = 1; i < g.size(); ++i) {
+        if (!live[i] || !isGateNode(g.nodes[i])) continue;
+        ++refs[nodeOf(g.nodes[i].f0)];
+        ++refs[nodeOf(g.nodes[i].f1)];
+    }
+    return refs;
+}
+
+//=============== TRUTH TABLES ===============//
+
+// Functions of up to four variables as 16-bit truth tables; variable i is
+// cut leaf i.
+constexpr uint16_t Proj[4] = {0xAAAA, 0xCCCC, 0xF0F0, 0xFF00};
+
+uint16_t cofactor0(uint16_t tt, int x) {
+    int s = 1 << x;
+    uint16_t lo = tt & ~Proj[x];
+    return static_cast<uint16_t>(lo | (lo << s));
+}
+
+uint16_t cofactor1(uint16_t tt, int x) {
+    int s = 1 << x;
+    uint16_t hi = tt & Proj[x];
+    return static_cast<uint16_t>(hi | (hi >> s));
+}
+
+bool dependsOn(uint16_t tt, int x) { return cofactor0(tt, x) != cofactor1(tt, x); }
+
+// Smallest AND/XOR decomposition found for each 4-input function, costed in
+// AIG nodes (inverters are free). A function that is AND, OR or XOR of one
+// variable with a smaller function takes one node more than that function;
+// anything else is split on the variable that gives the cheapest multiplexer.
+class Synthesizer {
+public:
+    Synthesizer() : memo(1 << 16) {}
+
+    int cost(uint16_t tt) {
+        Choice& c = memo[tt];
+        if (c.cost < 0) decide(tt);
+        return memo[tt].cost;
+    }
+
+    Lit build(Aig& g, uint16_t tt, const Lit* leaves) {
+        cost(tt);
+        Choice c = memo[tt];
+        int x = c.var;
+        Lit v = leaves[x];
+        uint16_t f0 = cofactor0(tt, x), f1 = cofactor1(tt, x);
+        switch (c.kind) {
+            case Const0: return 0;
+            case Const1: return 1;
+            case Var:    return v;
+            case NotVar: return v ^ 1;
+            case AndVar:    return g.mkAnd(v, build(g, f1, leaves));
+            case AndNotVar: return g.mkAnd(v ^ 1, build(g, f0, leaves));
+            case OrVar:     return g.mkOr(v, build(g, f0, leaves));
+            case OrNotVar:  return g.mkOr(v ^ 1, build(g, f1, leaves));
+            case XorVar:    return g.mkXor(v, build(g, f0, leaves));
+            case Mux:
+                return g.mkOr(g.mkAnd(v, build(g, f1, leaves)), g.mkAnd(v ^ 1, build(g, f0, leaves)));
+            case MuxXor0:
+                return g.mkXor(build(g, f0, leaves), g.mkAnd(v, build(g, f0 ^ f1, leaves)));
+            default:
+                return g.mkXor(build(g, f1, leaves), g.mkAnd(v ^ 1, build(g, f0 ^ f1, leaves)));
+        }
+    }
+
+private:
+    enum ChoiceKind : uint8_t {
+        Const0, Const1, Var, NotVar, AndVar, AndNotVar, OrVar, OrNotVar, XorVar, Mux, MuxXor0, MuxXor1
+    };
+    struct Choice {
+        int8_t cost = -1;
+        uint8_t kind = 0;
+        uint8_t var = 0;
+    };
+    std::vector<Choice> memo;
+
+    void decide(uint16_t tt) {
+        Choice best;
+        auto offer = [&](int cost, ChoiceKind kind, int x) {
+            if (best.cost < 0 || cost < best.cost) best = Choice{static_cast<int8_t>(cost), kind, static_cast<uint8_t>(x)};
+        };
+        if (tt == 0) offer(0, Const0, 0);
+        else if (tt == 0xFFFF) offer(0, Const1, 0);
+        for (int x = 0; x < 4 && best.cost != 0; ++x) {
+            if (tt == Proj[x]) offer(0, Var, x);
+            else if (tt == static_cast<uint16_t>(~Proj[x])) offer(0, NotVar, x);
+        }
+        if (best.cost == 0) {
+            memo[tt] = best;
+            return;
+        }
+        for (int x = 0; x < 4; ++x) {
+            if (!dependsOn(tt, x)) continue;
+            uint16_t f0 = cofactor0(tt, x), f1 = cofactor1(tt, x);
+            if (f0 == 0) offer(1 + cost(f1), AndVar, x);
+            else if (f1 == 0) offer(1 + cost(f0), AndNotVar, x);
+            else if (f1 == 0xFFFF) offer(1 + cost(f0), OrVar, x);
+            else if (f0 == 0xFFFF) offer(1 + cost(f1), OrNotVar, x);
+            else if (f1 == static_cast<uint16_t>(~f0)) offer(1 + cost(f0), XorVar, x);
+            else {
+                int c0 = cost(f0), c1 = cost(f1), cd = cost(f0 ^ f1);
+                offer(3 + c0 + c1, Mux, x);
+                offer(2 + c0 + cd, MuxXor0, x);
+                offer(2 + c1 + cd, MuxXor1, x);
+            }
+        }
+        memo[tt] = best;
+    }
+};
+
+//=============== CUTS ===============//
+
+constexpr int CutLeaves = 4;
+constexpr size_t MaxCuts = 8;
+
+struct Cut {
+    std::array<uint32_t, CutLeaves> leaves;
+    uint8_t size;
+    uint16_t tt;
+};
+
+// Re-expresses tt, a function of from's leaves, over the leaves of to, which
+// must contain them.
+uint16_t expand(uint16_t tt, const Cut& from, const Cut& to) {
+    int where[CutLeaves] = {0, 0, 0, 0};
+    for (int i = 0; i < from.size; ++i)
+        for (int j = 0; j < to.size; ++j)
+            if (to.leaves[j] == from.leaves[i]) where[i] = j;
+    uint16_t r = 0;
+    for (int m = 0; m < 16; ++m) {
+        int idx = 0;
+        for (int i = 0; i < from.size; ++i)
+            if ((m >> where[i]) & 1) idx |= 1 << i;
+        if ((tt >> idx) & 1) r |= static_cast<uint16_t>(1 << m);
+    }
+    return r;
+}
+
+bool mergeLeaves(const Cut& a, const Cut& b, Cut& out) {
+    int i = 0, j = 0, k = 0;
+    while (i < a.size || j < b.size) {
+        uint32_t next;
+        if (j >= b.size || (i < a.size && a.leaves[i] < b.leaves[j])) next = a.leaves[i++];
+        else if (i >= a.size || b.leaves[j] < a.leaves[i]) next = b.leaves[j++];
+        else { next = a.leaves[i++]; ++j; }
+        if (k == CutLeaves) return false;
+        out.leaves[k++] = next;
+    }
+    out.size = static_cast<uint8_t>(k);
+    return true;
+}
+
+// Up to MaxCuts cuts per node, smallest first, each followed by the trivial
+// cut {node} so parents can merge through it.
+std::vector<std::vector<Cut>> enumerateCuts(const Aig& g, const std::vector<char>& live) {
+    std::vector<std::vector<Cut>> cuts(g.size());
+    for (size_t n = 1; n < g.size(); ++n) {
+        if (!live[n]) continue;
+        const Node& node = g.nodes[n];
+        std::vector<Cut>& mine = cuts[n];
+        if (isGateNode(node)) {
+            for (const Cut& a : cuts[nodeOf(node.f0)]) {
+                for (const Cut& b : cuts[nodeOf(node.f1)]) {
+                    Cut c;
+                    if (!mergeLeaves(a, b, c)) continue;
+                    bool seen = false;
+                    for (const Cut& m : mine)
+                        if (m.size == c.size && m.leaves == c.leaves) seen = true;
+                    if (seen) continue;
+                    uint16_t ta = expand(a.tt, a, c), tb = expand(b.tt, b, c);
+                    if (isNeg(node.f0)) ta = static_cast<uint16_t>(~ta);
+                    if (isNeg(node.f1)) tb = static_cast<uint16_t>(~tb);
+                    c.tt = node.kind == Kind::And ? (ta & tb) : (ta ^ tb);
+                    mine.push_back(c);
+                }
+            }
+            std::stable_sort(mine.begin(), mine.end(), [](const Cut& x, const Cut& y) { return x.size < y.size; });
+            if (mine.size() > MaxCuts) mine.resize(MaxCuts);
+        }
+        Cut self;
+        self.leaves = {static_cast<uint32_t>(n), 0, 0, 0};
+        self.size = 1;
+        self.tt = Proj[0];
+        mine.push_back(self);
+    }
+    return cuts;
+}
+
+//=============== PASSES ===============//
+
+// Nodes n and everything below it that would die with it, stopping at the cut
+// leaves. refs is left as it was found.
+int deref(const Aig& g, uint32_t n, const Cut& cut, std::vector<int>& refs) {
+    int count = 1;
+    for (Lit f : {g.nodes[n].f0, g.nodes[n].f1}) {
+        uint32_t m = nodeOf(f);
+        if (!isGateNode(g.nodes[m]) || std::find(cut.leaves.begin(), cut.leaves.begin() + cut.size, m) != cut.leaves.begin() + cut.size)
+            continue;
+        if (--refs[m] == 0) count += deref(g, m, cut, refs);
+    }
+    return count;
+}
+
+void reref(const Aig& g, uint32_t n, const Cut& cut, std::vector<int>& refs) {
+    for (Lit f : {g.nodes[n].f0, g.nodes[n].f1}) {
+        uint32_t m = nodeOf(f);
+        if (!isGateNode(g.nodes[m]) || std::find(cut.leaves.begin(), cut.leaves.begin() + cut.size, m) != cut.leaves.begin() + cut.size)
+            continue;
+        if (refs[m]++ == 0) reref(g, m, cut, refs);
+    }
+}
+
+// Copies g node by node. A node is replaced by the synthesized form of one of
+// its cuts when that adds fewer nodes than its maximum fanout-free cone over
+// the cut, i.e. fewer than the rewrite frees.
+Aig rewritePass(const Aig& g, std::vector<Lit>& outs, Synthesizer& synth) {
+    std::vector<char> live = liveNodes(g, outs);
+    std::vector<int> refs = fanoutCounts(g, outs);
+    std::vector<std::vector<Cut>> cuts = enumerateCuts(g, live);
+
+    Aig ng;
+    std::vector<Lit> map(g.size(), 0);
+    auto mapped = [&](Lit l) { return map[nodeOf(l)] ^ (l & 1); };
+
+    for (size_t n = 1; n < g.size(); ++n) {
+        const Node& node = g.nodes[n];
+        if (node.kind == Kind::Input) {
+            map[n] = ng.input();
+            continue;
+        }
+        if (!live[n]) continue;
+
+        const Cut* best = nullptr;
+        int bestGain = 0;
+        for (const Cut& cut : cuts[n]) {
+            if (cut.size == 1 && cut.leaves[0] == n) continue;
+            int freed = deref(g, static_cast<uint32_t>(n), cut, refs);
+            reref(g, static_cast<uint32_t>(n), cut, refs);
+            Lit leaves[CutLeaves] = {0, 0, 0, 0};
+            for (int i = 0; i < cut.size; ++i) leaves[i] = map[cut.leaves[i]];
+            size_t mark = ng.size();
+            synth.build(ng, cut.tt, leaves);
+            int added = static_cast<int>(ng.size() - mark);
+            ng.truncate(mark);
+            if (freed - added > bestGain) {
+                bestGain = freed - added;
+                best = &cut;
+            }
+        }
+
+        if (best) {
+            Lit leaves[CutLeaves] = {0, 0, 0, 0};
+            for (int i = 0; i < best->size; ++i) leaves[i] = map[best->leaves[i]];
+            map[n] = synth.build(ng, best->tt, leaves);
+        } else {
+            map[n] = ng.make(node.kind, mapped(node.f0), mapped(node.f1));
+        }
+    }
+    for (Lit& o : outs) o = mapped(o);
+    return ng;
+}
+
+// Rebuilds every AND and XOR tree whose inner nodes have no other reader as
+// a balanced tree, always combining the two shallowest operands first.
+Aig balancePass(const Aig& g, std::vector<Lit>& outs) {
+    std::vector<char> live = liveNodes(g, outs);
+    std::vector<int> refs = fanoutCounts(g, outs);
+
+    Aig ng;
+    std::vector<Lit> map(g.size(), 0);
+    for (size_t n = 1; n < g.size(); ++n) {
+        const Node& node = g.nodes[n];
+        if (node.kind == Kind::Input) {
+            map[n] = ng.input();
+            continue;
+        }
+        if (!live[n]) continue;
+
+        std::vector<Lit> terms, stack{node.f0, node.f1};
+        while (!stack.empty()) {
+            Lit l = stack.back();
+            stack.pop_back();
+            const Node& m = g.nodes[nodeOf(l)];
+            if (m.kind == node.kind && !isNeg(l) && refs[nodeOf(l)] == 1 && terms.size() + stack.size() < 64) {
+                stack.push_back(m.f0);
+                stack.push_back(m.f1);
+            } else {
+                terms.push_back(map[nodeOf(l)] ^ (l & 1));
+            }
+        }
+
+        auto deeper = [&](Lit a, Lit b) { return ng.level[nodeOf(a)] > ng.level[nodeOf(b)]; };
+        std::priority_queue<Lit, std::vector<Lit>, decltype(deeper)> queue(deeper, terms);
+        while (queue.size() > 1) {
+            Lit a = queue.top();
+            queue.pop();
+            Lit b = queue.top();
+            queue.pop();
+            queue.push(ng.make(node.kind, a, b));
+        }
+        map[n] = queue.top();
+    }
+    for (Lit& o : outs) o = map[nodeOf(o)] ^ (o & 1);
+    return ng;
+}
+
+//=============== CONVERSION ===============//
+
+// bitMapping to Aig. Inputs become the first argc Aig inputs and each Undef
+// node one more, in index order.
+Aig fromGraph(const CompilationContext& cx, const std::vector<int>& out, std::vector<Lit>& outs) {
+    Aig g;
+    std::vector<Lit> map(cx.bitMapping.size(), 0);
+    map[1] = 1;
+    for (size_t i = 2; i < cx.bitMapping.size(); ++i) {
+        const Bit& b = cx.bitMapping[i];
+        switch (b.op) {
+            case Op::Const0: map[i] = 0; break;
+            case Op::Const1: map[i] = 1; break;
+            case Op::Input:  map[i] = g.input(); break;
+            case Op::Undef:  map[i] = g.input(); break;
+            case Op::And:    map[i] = g.mkAnd(map[b.lhs], map[b.rhs]); break;
+            case Op::Or:     map[i] = g.mkOr(map[b.lhs], map[b.rhs]); break;
+            case Op::Xor:    map[i] = g.mkXor(map[b.lhs], map[b.rhs]); break;
+            case Op::Not:    map[i] = map[b.lhs] ^ 1; break;
+        }
+    }
+    outs.clear();
+    for (int o : out) outs.push_back(map[o]);
+    return g;
+}
+
+// Aig back to a bitMapping-shaped graph. An AND of two complemented fanins is
+// emitted as OR with the complement on its output, and a node only gets a NOT
+// for a polarity some reader asks for.
+std::vector<Bit> toGraph(const Aig& g, int argc, const std::vector<Lit>& outs, std::vector<int>& out) {
+    size_t n = g.size();
+    // Natural polarity of each node: 1 when it is built as an OR.
+    auto natural = [&](size_t i) {
+        const Node& x = g.nodes[i];
+        return x.kind == Kind::And && isNeg(x.f0) && isNeg(x.f1) ? 1 : 0;
+    };
+
+    std::vector<uint8_t> need(n, 0);
+    for (Lit o : outs) need[nodeOf(o)] |= 1 << (o & 1);
+    for (size_t i = n; i-- > 1;) {
+        if (!need[i] || !isGateNode(g.nodes[i])) continue;
+        int nat = natural(i);
+        need[i] |= 1 << nat;
+        const Node& x = g.nodes[i];
+        for (Lit f : {x.f0, x.f1}) {
+            Lit operand = nat ? f ^ 1 : f;
+            need[nodeOf(operand)] |= 1 << (operand & 1);
+        }
+    }
+
+    std::vector<Bit> graph;
+    graph.push_back(Bit{-1, -1, Op::Const0});
+    graph.push_back(Bit{-1, -1, Op::Const1});
+    for (int i = 0; i < argc; ++i) graph.push_back(Bit{-1, -1, Op::Input});
+    auto emit = [&](Op op, int lhs, int rhs) {
+        graph.push_back(Bit{lhs, rhs, op});
+        return static_cast<int>(graph.size()) - 1;
+    };
+
+    std::vector<std::array<int, 2>> idx(n, {-1, -1});
+    idx[0] = {0, 1};
+    int input = 0;
+    for (size_t i = 1; i < n; ++i) {
+        const Node& x = g.nodes[i];
+        if (x.kind == Kind::Input) {
+            int k = input++;
+            if (!need[i]) continue;
+            idx[i][0] = k < argc ? 2 + k : emit(Op::Undef, -1, -1);
+            if (need[i] & 2) idx[i][1] = emit(Op::Not, idx[i][0], -1);
+            continue;
+        }
+        if (!need[i]) continue;
+        auto operand = [&](Lit l) { return idx[nodeOf(l)][l & 1]; };
+        int nat = natural(i);
+        int built;
+        if (x.kind == Kind::Xor) built = emit(Op::Xor, operand(x.f0), operand(x.f1));
+        else if (nat) built = emit(Op::Or, operand(x.f0 ^ 1), operand(x.f1 ^ 1));
+        else built = emit(Op::And, operand(x.f0), operand(x.f1));
+        idx[i][nat] = built;
+        if (need[i] & (1 << (1 - nat))) idx[i][1 - nat] = emit(Op::Not, built, -1);
+    }
+
+    out.clear();
+    for (Lit o : outs) out.push_back(idx[nodeOf(o)][o & 1]);
+    return graph;
+}
+
+} // namespace
+
+RewriteReport synthesizeGraph(CompilationContext& cx, std::vector<int>& out) {
+    RewriteReport report = rewriteGraph(cx, out);
+    if (!cx.wordOps.empty() || !cx.tableOps.empty() || !cx.fieldOps.empty()) return report;
+
+    std::vector<Bit> savedGraph = cx.bitMapping;
+    std::vector<int> savedOut = out;
+    std::vector<LoopRegion> savedLoops = cx.loopRegions;
+    auto savedTable = cx.gateTable;
+
+    int argc = 0;
+    while (2 + argc < static_cast<int>(cx.bitMapping.size()) && cx.bitMapping[2 + argc].op == Op::Input) ++argc;
+
+    std::vector<Lit> outs;
+    Aig g = fromGraph(cx, out, outs);
+    Synthesizer synth;
+    int nodes = gateCount(g, outs);
+    const int maxPasses = 4;
+    for (int pass = 0; pass < maxPasses; ++pass) {
+        std::vector<Lit> nextOuts = outs;
+        Aig next = rewritePass(g, nextOuts, synth);
+        int nextNodes = gateCount(next, nextOuts);
+        if (nextNodes >= nodes) break;
+        g = std::move(next);
+        outs = std::move(nextOuts);
+        nodes = nextNodes;
+        ++report.rounds;
+    }
+    g = balancePass(g, outs);
+
+    cx.bitMapping = toGraph(g, argc, outs, out);
+    cx.loopRegions.clear();
+    RewriteReport lowered = rewriteGraph(cx, out);
+    report.rounds += lowered.rounds;
+
+    if (lowered.gatesAfter < report.gatesAfter) {
+        report.gatesAfter = lowered.gatesAfter;
+        return report;
+    }
+
+    cx.bitMapping = std::move(savedGraph);
+    out = std::move(savedOut);
+    cx.loopRegions = std::move(savedLoops);
+    cx.gateTable = std::move(savedTable);
+    return report;
+}
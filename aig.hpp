@@ -0,0 +1,27 @@
+#pragma once
+#include <vector>
+#include "optimizer.hpp"
+
+// Re-synthesizes the gate graph SemanticAnalyzer::analyze left in cx. The
+// graph is converted to an And-Inverter Graph that also keeps XOR as a node
+// (ciphers are mostly XOR, and spelling each one as three ANDs would hide
+// it), then:
+//
+//  - every node's 4-input cuts are enumerated with their truth tables, and a
+//    cut is re-synthesized whenever the new logic is smaller than the part of
+//    the old cone only that node used;
+//  - AND and XOR trees are rebalanced by level;
+//  - the result is lowered back to AND/OR/XOR/NOT, choosing the polarity of
+//    each node so inverters fold into OR gates where they can,
+//
+// and finished with rewriteGraph. The new graph is kept only if it has fewer
+// live gates than rewriteGraph alone leaves; otherwise nothing changes.
+//
+// A graph that still has wordOps, tableOps or fieldOps after rewriteGraph is
+// left there: cGenWord computes its adders, lookups and field multiplies
+// directly, which is worth more than fewer gates.
+//
+// out is rewritten in place and keeps its order. The re-synthesized circuit
+// is straight-line, so when it is kept loopRegions is cleared and every
+// backend emits repeat loops unrolled.
+RewriteReport synthesizeGraph(CompilationContext& cx, std::vector<int>& out);
@@ -1,103 +1,276 @@
 #pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
-#include <memory>
 
 struct Expr;
 struct Stmt;
 struct Decl;
 
-using ExprPtr = std::unique_ptr<Expr>;
-using StmtPtr = std::unique_ptr<Stmt>;
-using DeclPtr = std::unique_ptr<Decl>;
+using ExprPtr = Expr*;
+using StmtPtr = Stmt*;
+using DeclPtr = Decl*;
+
+// Fixed array of child nodes, stored in the arena next to its siblings.
+template <class T>
+struct AstList {
+    T* const* items = nullptr;
+    size_t count = 0;
+
+    T* const* begin() const { return items; }
+    T* const* end() const { return items + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T* operator[](size_t i) const { return items[i]; }
+};
+
+// Owns every node of a Program. Nodes are bump-allocated in parse order and
+// released together when the Program goes away; only nodes that own heap
+// memory (names, operator strings) get a destructor call.
+class AstArena {
+public:
+    AstArena() = default;
+    AstArena(const AstArena&) = delete;
+    AstArena& operator=(const AstArena&) = delete;
+    AstArena(AstArena&& other) noexcept { *this = std::move(other); }
+    AstArena& operator=(AstArena&& other) noexcept {
+        if (this != &other) {
+            release();
+            blocks = std::move(other.blocks);
+            destructors = std::move(other.destructors);
+            cur = other.cur;
+            left = other.left;
+            nodes = other.nodes;
+            other.blocks.clear();
+            other.destructors.clear();
+            other.cur = nullptr;
+            other.left = 0;
+            other.nodes = 0;
+        }
+        return *this;
+    }
+    ~AstArena() { release(); }
+
+    template <class T, class... Args>
+    T* make(Args&&... args) {
+        T* node = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        ++nodes;
+        if constexpr (!std::is_trivially_destructible_v<T>)
+            destructors.push_back({node, [](void* p) { static_cast<T*>(p)->~T(); }});
+        return node;
+    }
+
+    // Zero-filled storage for n trivially copyable values.
+    template <class T>
+    T* array(size_t n) {
+        static_assert(std::is_trivially_copyable_v<T>, "arena arrays hold plain values");
+        auto mem = static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+        std::memset(static_cast<void*>(mem), 0, n * sizeof(T));
+        return mem;
+    }
+
+    template <class T>
+    AstList<T> list(const std::vector<T*>& items) {
+        AstList<T> out;
+        if (items.empty()) return out;
+        T** mem = array<T*>(items.size());
+        std::memcpy(mem, items.data(), items.size() * sizeof(T*));
+        out.items = mem;
+        out.count = items.size();
+        return out;
+    }
+
+    // Nodes built with make; arrays and lists are not counted.
+    size_t nodeCount() const { return nodes; }
+
+private:
+    static constexpr size_t BlockSize = 16384;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::vector<std::pair<void*, void (*)(void*)>> destructors;
+    char* cur = nullptr;
+    size_t left = 0;
+    size_t nodes = 0;
+
+    void* allocate(size_t size, size_t align) {
+        size_t pad = (align - reinterpret_cast<uintptr_t>(cur) % align) % align;
+        if (!cur || pad + size > left) {
+            size_t bytes = std::max(BlockSize, size + align);
+            blocks.emplace_back(new char[bytes]);
+            cur = blocks.back().get();
+            left = bytes;
+            pad = (align - reinterpret_cast<uintptr_t>(cur) % align) % align;
+        }
+        void* p = cur + pad;
+        cur += pad + size;
+        left -= pad + size;
+        return p;
+    }
+
+    void release() {
+        for (auto it = destructors.rbegin(); it != destructors.rend(); ++it) it->second(it->first);
+        destructors.clear();
+        blocks.clear();
+        cur = nullptr;
+        left = 0;
+        nodes = 0;
+    }
+};
+
 
+// Constant of any width, decoded once by the parser. Bits are MSB first and
+// packed from the top of each word: bit i is words[i / 64] >> (63 - i % 64).
+struct BitLiteral {
+    const uint64_t* words = nullptr;
+    int width = 0;
+
+    int bit(int i) const { return static_cast<int>((words[i >> 6] >> (63 - (i & 63))) & 1); }
+};
 
 //===============EXPRESSIONS===============//
 
+enum class ExprKind : uint8_t { Data, Var, Binary, Concat, Not, Call, Index, Slice };
+
 struct Expr {
-    virtual ~Expr() = default;
+    const ExprKind kind;
+protected:
+    explicit Expr(ExprKind k) : kind(k) {}
 };
 
+// 0x digits give four bits each; decimal digits are read as one bit each
+// (any nonzero digit is a 1). When decimal and small enough, the same digits
+// read as a number are kept in amount for use as a shift count, else -1.
 struct DataExpr : Expr {
-    std::string value;
-    DataExpr(const std::string& v) : value(v) {}
+    BitLiteral bits;
+    bool decimal;
+    int amount;
+    DataExpr(BitLiteral b, bool d, int a) : Expr(ExprKind::Data), bits(b), decimal(d), amount(a) {}
 };
 
 struct VarExpr : Expr {
     std::string name;
-    VarExpr(const std::string& n) : name(n) {}
+    VarExpr(const std::string& n) : Expr(ExprKind::Var), name(n) {}
 };
 
 struct BinaryExpr : Expr {
     std::string op;
     ExprPtr lhs, rhs;
     BinaryExpr(const std::string& o, ExprPtr l, ExprPtr r)
-        : op(o), lhs(std::move(l)), rhs(std::move(r)) {}
+        : Expr(ExprKind::Binary), op(o), lhs(l), rhs(r) {}
 };
 
 struct ConcatExpr : Expr {
-    std::vector<ExprPtr> operands;
-    ConcatExpr(std::vector<ExprPtr> o) : operands(std::move(o)) {}
+    AstList<Expr> operands;
+    ConcatExpr(AstList<Expr> o) : Expr(ExprKind::Concat), operands(o) {}
 };
 
 struct NotExpr : Expr {
     ExprPtr expr;
-    NotExpr(ExprPtr e) : expr(std::move(e)) {}
+    NotExpr(ExprPtr e) : Expr(ExprKind::Not), expr(e) {}
 };
 
 struct CallExpr : Expr {
     ExprPtr callee;
     ExprPtr arg;
-    CallExpr(ExprPtr c, ExprPtr a) : callee(std::move(c)), arg(std::move(a)) {}
+    ExprPtr arg2 = nullptr;   // second operand of a field multiply
+    CallExpr(ExprPtr c, ExprPtr a, ExprPtr a2 = nullptr) : Expr(ExprKind::Call), callee(c), arg(a), arg2(a2) {}
 };
 
+// Negative positions count back from the container's width; an open slice
+// end (x[a:]) is stored as -1.
 struct IndexExpr : Expr {
     ExprPtr container;
-    std::string index;
-    IndexExpr(ExprPtr c, const std::string& i) : container(std::move(c)), index(i) {}
+    int index;
+    IndexExpr(ExprPtr c, int i) : Expr(ExprKind::Index), container(c), index(i) {}
 };
 
 struct SliceExpr : Expr {
     ExprPtr container;
-    std::string start, end;
-    SliceExpr(ExprPtr c, const std::string& s, const std::string& e)
-        : container(std::move(c)), start(s), end(e) {}
+    int start, end;
+    SliceExpr(ExprPtr c, int s, int e) : Expr(ExprKind::Slice), container(c), start(s), end(e) {}
 };
 
 //===============STATEMENTS===============//
 
+enum class StmtKind : uint8_t { Assign, Return, Repeat };
+
 struct Stmt {
-    virtual ~Stmt() = default;
+    const StmtKind kind;
+protected:
+    explicit Stmt(StmtKind k) : kind(k) {}
 };
 
 struct AssignStmt : Stmt {
     ExprPtr lhs;
     ExprPtr rhs;
-    AssignStmt(ExprPtr lhs, ExprPtr rhs) : lhs(std::move(lhs)) , rhs(std::move(rhs)){}
+    AssignStmt(ExprPtr lhs, ExprPtr rhs) : Stmt(StmtKind::Assign), lhs(lhs), rhs(rhs) {}
 };
 
 struct ReturnStmt : Stmt {
     ExprPtr value;
-    ReturnStmt(ExprPtr v) : value(std::move(v)) {}
+    ReturnStmt(ExprPtr v) : Stmt(StmtKind::Return), value(v) {}
+};
+
+// repeat N { ... }: the body runs N times in a row against the same variables.
+struct RepeatStmt : Stmt {
+    int count;
+    AstList<Stmt> body;
+    RepeatStmt(int c, AstList<Stmt> b) : Stmt(StmtKind::Repeat), count(c), body(b) {}
 };
 
 //===============DECLARATIONS===============//
 
+enum class DeclKind : uint8_t { Func, Table, Field };
+
 struct Decl {
-    virtual ~Decl() = default;
+    const DeclKind kind;
+protected:
+    explicit Decl(DeclKind k) : kind(k) {}
 };
 
+// argc is the input width declared by main (function main : N), -1 for
+// every other function.
 struct FuncDecl : Decl {
     std::string name;
-    std::vector<StmtPtr> body;
-    std::string argc;
+    AstList<Stmt> body;
+    int argc = -1;
+
+    FuncDecl() : Decl(DeclKind::Func) {}
+    FuncDecl(const std::string& n, AstList<Stmt> b, int a)
+        : Decl(DeclKind::Func), name(n), body(b), argc(a) {}
+};
+
+// table Name : in -> out { e0, e1, ... }: 2^in entries of out bits each.
+// Calling it looks up the entry indexed by the argument read as an unsigned
+// number, most significant bit first.
+struct TableDecl : Decl {
+    std::string name;
+    int inBits = 0;
+    int outBits = 0;
+    const uint64_t* entries = nullptr;
+
+    TableDecl() : Decl(DeclKind::Table) {}
+};
+
+// field Name : n = r; declares GF(2^n) modulo x^n + r. Calling Name(a, b)
+// multiplies two n-bit elements. Bit i of an element, MSB-first, is the
+// coefficient of x^(n-1-i), so r's lowest bit is its constant term.
+struct FieldDecl : Decl {
+    std::string name;
+    int bits = 0;
+    uint64_t poly = 0;
 
-    FuncDecl() = default;
-    FuncDecl(const std::string& n,
-             std::vector<StmtPtr> b, const std::string& a)
-        : name(n), body(std::move(b)), argc(a){}
+    FieldDecl() : Decl(DeclKind::Field) {}
 };
 
 struct Program {
+    AstArena arena;
     std::vector<DeclPtr> decls;
 };
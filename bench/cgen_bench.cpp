@@ -0,0 +1,125 @@
+// Compares the per-bit cGen backend against the word-level cGenWord backend.
+// Both kernels are emitted into one C file together with a timing harness,
+// compiled with $CC (default cc) and run. A block is one call's input; the
+// word kernel is also timed through its _batch entry point.
+//
+//   g++ -std=c++17 -O2 -I.. cgen_bench.cpp ../source.cpp ../preprocessor.cpp
+//       ../lexer.cpp ../parser.cpp ../semantics.cpp ../codegen.cpp -o cgen_bench
+//   ./cgen_bench ../example.bits [iterations]
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "../source.hpp"
+#include "../preprocessor.hpp"
+#include "../lexer.hpp"
+#include "../parser.hpp"
+#include "../semantics.hpp"
+
+static std::string harness(int inpBytes, int outBytes, long iterations) {
+    std::string in = std::to_string(inpBytes);
+    std::string out = std::to_string(outBytes);
+    std::string code;
+    code += "#include <stdint.h>\n";
+    code += "#include <stdio.h>\n";
+    code += "#include <string.h>\n";
+    code += "#include <time.h>\n\n";
+    code += "static unsigned long long rng = 88172645463325252ULL;\n";
+    code += "static void fill(uint8_t* p, int n) {\n";
+    code += "    for (int i = 0; i < n; i++) {\n";
+    code += "        rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;\n";
+    code += "        p[i] = (uint8_t)rng;\n";
+    code += "    }\n";
+    code += "}\n\n";
+    code += "static double now(void) {\n";
+    code += "    struct timespec ts;\n";
+    code += "    clock_gettime(CLOCK_MONOTONIC, &ts);\n";
+    code += "    return ts.tv_sec + ts.tv_nsec * 1e-9;\n";
+    code += "}\n\n";
+    code += "typedef void (*kernel_fn)(const uint8_t*, uint8_t*);\n\n";
+    code += "static uint8_t pool[4096][" + in + " + 1];\n";
+    code += "static uint8_t records[4096 * (" + in + " + 1)];\n";
+    code += "static uint8_t results[4096 * (" + out + " + 1)];\n\n";
+    code += "static double run(kernel_fn f, long n, unsigned* sink) {\n";
+    code += "    unsigned acc = 0;\n";
+    code += "    uint8_t o[" + out + " + 1];\n";
+    code += "    double t0 = now();\n";
+    code += "    for (long i = 0; i < n; i++) {\n";
+    code += "        f(pool[i & 4095], o);\n";
+    code += "        acc += o[0];\n";
+    code += "    }\n";
+    code += "    double t1 = now();\n";
+    code += "    *sink += acc;\n";
+    code += "    return (t1 - t0) * 1e9 / n;\n";
+    code += "}\n\n";
+    code += "int main(void) {\n";
+    code += "    long n = " + std::to_string(iterations) + ";\n";
+    code += "    unsigned sink = 0;\n";
+    code += "    int mismatches = 0;\n";
+    code += "    for (int t = 0; t < 4096; t++) {\n";
+    code += "        uint8_t a[" + out + " + 1], b[" + out + " + 1];\n";
+    code += "        fill(pool[t], " + in + ");\n";
+    code += "        memcpy(records + t * " + in + ", pool[t], " + in + ");\n";
+    code += "        bench_bit(pool[t], a);\n";
+    code += "        bench_word(pool[t], b);\n";
+    code += "        if (memcmp(a, b, " + out + ")) mismatches++;\n";
+    code += "    }\n";
+    code += "    double bit = run(bench_bit, n, &sink);\n";
+    code += "    double word = run(bench_word, n, &sink);\n";
+    code += "    long rounds = n / 4096 + 1;\n";
+    code += "    double t0 = now();\n";
+    code += "    for (long r = 0; r < rounds; r++) bench_word_batch(records, results, 4096);\n";
+    code += "    double batch = (now() - t0) * 1e9 / (rounds * 4096.0);\n";
+    code += "    for (int t = 0; t < 4096; t++) {\n";
+    code += "        uint8_t b[" + out + " + 1];\n";
+    code += "        bench_word(pool[t], b);\n";
+    code += "        if (memcmp(b, results + t * " + out + ", " + out + ")) mismatches++;\n";
+    code += "    }\n";
+    code += "    printf(\"per-bit : %8.2f ns/call %10.3f Mblocks/s\\n\", bit, 1e3 / bit);\n";
+    code += "    printf(\"word    : %8.2f ns/call %10.3f Mblocks/s\\n\", word, 1e3 / word);\n";
+    code += "    printf(\"batch   : %8.2f ns/call %10.3f Mblocks/s\\n\", batch, 1e3 / batch);\n";
+    code += "    printf(\"speedup : %8.2fx\\n\", bit / word);\n";
+    code += "    printf(\"mismatches: %d / 8192 (checksum %u)\\n\", mismatches, sink);\n";
+    code += "    return 0;\n";
+    code += "}\n";
+    return code;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <file.bits> [iterations]\n";
+        return 1;
+    }
+    long iterations = argc > 2 ? std::atol(argv[2]) : 10000000;
+
+    try {
+        SourceFile file(argv[1]);
+        std::string src = Preprocessor::process(file.text());
+        Lexer lexer(src);
+        std::vector<Token> tokens = lexer.tokenize();
+        Parser parser(tokens);
+        Program program = parser.parseProgram();
+        SemanticAnalyzer analyzer;
+        std::vector<int> out = analyzer.analyze(&program);
+
+        int inpBytes = (analyzer.mainArgc() + 7) / 8;
+        int outBytes = (static_cast<int>(out.size()) + 7) / 8;
+
+        std::ofstream c("cgen_bench_kernels.c");
+        c << analyzer.cGenWord("bench_word", out) << "\n";
+        c << analyzer.cGen("bench_bit", out) << "\n";
+        c << harness(inpBytes, outBytes, iterations);
+        c.close();
+
+        const char* cc = std::getenv("CC");
+        std::string cmd = std::string(cc ? cc : "cc") +
+                          " -O2 -o cgen_bench_kernels cgen_bench_kernels.c";
+        if (std::system(cmd.c_str()) != 0) throw std::runtime_error("C compilation failed: " + cmd);
+        return std::system("./cgen_bench_kernels") == 0 ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,86 @@
+// Compiles a batch of generated programs once on one thread and once with
+// compileBatch on every core, checks that both runs emit the same C for every
+// program, and reports the speedup.
+//
+//   g++ -std=c++17 -O2 -pthread -I.. parallel_bench.cpp ../compiler.cpp ../preprocessor.cpp
+//       ../lexer.cpp ../parser.cpp ../semantics.cpp ../optimizer.cpp ../aig.cpp
+//       ../codegen.cpp -o parallel_bench
+//   ./parallel_bench [programs] [rounds] [threads]
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../compiler.hpp"
+
+// A Feistel network over 64 bits whose key schedule and round count differ
+// per program, so no two jobs build the same graph.
+static std::string syntheticSource(int seed, int rounds) {
+    std::string src;
+    src += "mask Block64 {\n    L : 32;\n    R : 32;\n};\n\n";
+    src += "table S : 4 -> 4 {\n";
+    src += "    0xC, 0x5, 0x6, 0xB, 0x9, 0x0, 0xA, 0xD,\n";
+    src += "    0x3, 0xE, 0xF, 0x8, 0x4, 0x7, 0x1, 0x2\n}\n\n";
+    src += "function F {\n";
+    src += "    a = S(F[0:4]);\n";
+    src += "    b = S(F[4:8]);\n";
+    src += "    lo = F[8:32];\n";
+    src += "    r = a :: b :: lo;\n";
+    src += "    s = r + 0x" + std::to_string(1000 + seed % 9000) + "ABCD;\n";
+    src += "    return s;\n}\n\n";
+    src += "function round {\n";
+    src += "    L = round[Block64.L];\n";
+    src += "    R = round[Block64.R];\n";
+    src += "    f = F(R);\n";
+    src += "    newR = L ^ f;\n";
+    src += "    out = R :: newR;\n";
+    src += "    return out;\n}\n\n";
+    src += "function main : 64 {\n    s = main;\n";
+    for (int r = 0; r < rounds + seed % 4; ++r) src += "    s = round(s);\n";
+    src += "    return s;\n}\n";
+    return src;
+}
+
+static double seconds(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char** argv) {
+    int programs = argc > 1 ? std::atoi(argv[1]) : 32;
+    int rounds = argc > 2 ? std::atoi(argv[2]) : 16;
+    unsigned threads = argc > 3 ? static_cast<unsigned>(std::atoi(argv[3])) : 0;
+
+    std::vector<CompileJob> jobs(programs);
+    for (int p = 0; p < programs; ++p) {
+        jobs[p].source = syntheticSource(p, rounds);
+        jobs[p].name = "kernel" + std::to_string(p);
+        jobs[p].optLevel = p % 3;
+        jobs[p].backend = static_cast<Backend>(p % 3);
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<CompileResult> serial = compileBatch(jobs, 1);
+    double serialTime = seconds(t0);
+
+    t0 = std::chrono::steady_clock::now();
+    std::vector<CompileResult> parallel = compileBatch(jobs, threads);
+    double parallelTime = seconds(t0);
+
+    int failed = 0, mismatches = 0;
+    for (int p = 0; p < programs; ++p) {
+        if (!serial[p].ok()) {
+            std::cerr << "program " << p << ": " << serial[p].error << "\n";
+            ++failed;
+        }
+        if (serial[p].code != parallel[p].code || serial[p].error != parallel[p].error) ++mismatches;
+    }
+
+    std::cout << "programs  : " << programs << "\n";
+    std::cout << "serial    : " << serialTime * 1e3 << " ms\n";
+    std::cout << "parallel  : " << parallelTime * 1e3 << " ms\n";
+    std::cout << "speedup   : " << serialTime / parallelTime << "x\n";
+    std::cout << "failed    : " << failed << "\n";
+    std::cout << "mismatches: " << mismatches << " / " << programs << "\n";
+    return failed || mismatches ? 1 : 0;
+}
@@ -0,0 +1,158 @@
+// Times each compiler phase on a generated program whose size scales with
+// one knob:
+//
+//   masks    N masks of 8 fields each and N mask field references
+//   calls    a chain of N functions, each calling the next
+//   literals an N-bit main XORed, ANDed and added with N-bit hex literals
+//   rounds   N Feistel rounds of 64 bits written out inline in main, about
+//            300 gates each, so 3500 rounds is a million-gate graph
+//
+//   g++ -std=c++17 -O2 -pthread -I.. phase_bench.cpp ../preprocessor.cpp ../lexer.cpp
+//       ../parser.cpp ../semantics.cpp ../codegen.cpp -o phase_bench
+//   ./phase_bench <shape> <N> [out.bits]
+//
+// With out.bits the program is also written there, so cgen_bench can
+// measure what the generated C does with it.
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "../preprocessor.hpp"
+#include "../lexer.hpp"
+#include "../parser.hpp"
+#include "../semantics.hpp"
+
+static std::string hexDigits(int digits, unsigned seed) {
+    static const char* hex = "0123456789ABCDEF";
+    std::string s;
+    for (int i = 0; i < digits; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        s += hex[(seed >> 16) & 15];
+    }
+    return s;
+}
+
+static std::string masksSource(int n) {
+    std::string src;
+    for (int m = 0; m < n; ++m) {
+        src += "mask M" + std::to_string(m) + " {\n";
+        for (int f = 0; f < 8; ++f) src += "    f" + std::to_string(f) + " : 4;\n";
+        src += "};\n";
+    }
+    src += "function main : 32 {\n    acc = main;\n";
+    for (int r = 0; r < n; ++r) {
+        std::string m = "M" + std::to_string((r * 7919LL) % n);
+        std::string f = std::to_string((r * 31) % 8);
+        src += "    v = main[" + m + ".f" + f + "];\n";
+        src += "    acc[" + m + ".f" + f + "] = acc[" + m + ".f" + std::to_string((r * 17 + 3) % 8) + "] ^ v;\n";
+    }
+    src += "    return acc;\n}\n";
+    return src;
+}
+
+static std::string callsSource(int n) {
+    std::string src;
+    for (int d = n - 1; d >= 0; --d) {
+        std::string name = "f" + std::to_string(d);
+        src += "function " + name + " {\n";
+        src += "    x = " + name + " ^ 0x" + hexDigits(8, d) + ";\n";
+        src += "    y = x <<< " + std::to_string(1 + d % 31) + ";\n";
+        if (d + 1 < n) src += "    z = f" + std::to_string(d + 1) + "(y);\n";
+        else src += "    z = y + 0x" + hexDigits(8, d + 1) + ";\n";
+        src += "    return z;\n}\n\n";
+    }
+    src += "function main : 32 {\n    r = f0(main);\n    return r;\n}\n";
+    return src;
+}
+
+static std::string literalsSource(int n) {
+    int digits = (n + 3) / 4;
+    int bits = digits * 4;
+    std::string src = "function main : " + std::to_string(bits) + " {\n";
+    src += "    a = main ^ 0x" + hexDigits(digits, 1) + ";\n";
+    src += "    b = a & 0x" + hexDigits(digits, 2) + ";\n";
+    src += "    c = b | 0x" + hexDigits(digits, 3) + ";\n";
+    src += "    d = c + 0x" + hexDigits(digits, 4) + ";\n";
+    src += "    return d;\n}\n";
+    return src;
+}
+
+static std::string roundsSource(int n) {
+    std::string src;
+    src += "table S : 4 -> 4 {\n";
+    src += "    0xC, 0x5, 0x6, 0xB, 0x9, 0x0, 0xA, 0xD,\n";
+    src += "    0x3, 0xE, 0xF, 0x8, 0x4, 0x7, 0x1, 0x2\n}\n\n";
+    src += "function main : 64 {\n    s = main;\n";
+    for (int r = 0; r < n; ++r) {
+        src += "    L = s[0:32];\n";
+        src += "    R = s[32:64];\n";
+        src += "    k = R ^ 0x" + hexDigits(8, r) + ";\n";
+        for (int q = 0; q < 8; ++q)
+            src += "    n" + std::to_string(q) + " = S(k[" + std::to_string(4 * q) + ":" + std::to_string(4 * q + 4) + "]);\n";
+        src += "    m = n0 :: n1 :: n2 :: n3 :: n4 :: n5 :: n6 :: n7;\n";
+        src += "    f = m <<< " + std::to_string(1 + r % 31) + ";\n";
+        src += "    g = f + R;\n";
+        src += "    newR = L ^ g;\n";
+        src += "    s = R :: newR;\n";
+    }
+    src += "    return s;\n}\n";
+    return src;
+}
+
+template <class F>
+static double timed(F&& f) {
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " masks|calls|literals|rounds <N> [out.bits]\n";
+        return 1;
+    }
+    std::string shape = argv[1];
+    int n = std::atoi(argv[2]);
+
+    try {
+        std::string src;
+        if (shape == "masks") src = masksSource(n);
+        else if (shape == "calls") src = callsSource(n);
+        else if (shape == "literals") src = literalsSource(n);
+        else if (shape == "rounds") src = roundsSource(n);
+        else throw std::runtime_error("Unknown shape " + shape);
+        if (argc > 3) std::ofstream(argv[3]) << src;
+
+        std::string pre;
+        std::vector<Token> tokens;
+        Program program;
+        SemanticAnalyzer analyzer;
+        std::vector<int> out;
+        std::string bitCode, wordCode;
+
+        double tPre = timed([&] { pre = Preprocessor::process(src); });
+        Lexer lexer(pre);
+        double tLex = timed([&] { tokens = lexer.tokenize(); });
+        Parser parser(tokens);
+        double tParse = timed([&] { program = parser.parseProgram(); });
+        double tAnalyze = timed([&] { out = analyzer.analyze(&program); });
+        double tGen = timed([&] { bitCode = analyzer.cGen("bench_bit", out); });
+        double tWord = timed([&] { wordCode = analyzer.cGenWord("bench_word", out); });
+
+        std::cout << "source    : " << src.size() << " bytes, " << tokens.size() << " tokens\n";
+        std::cout << "graph     : " << analyzer.context().bitMapping.size() << " nodes\n";
+        std::cout << "preprocess: " << tPre << " ms\n";
+        std::cout << "tokenize  : " << tLex << " ms\n";
+        std::cout << "parse     : " << tParse << " ms\n";
+        std::cout << "analyze   : " << tAnalyze << " ms\n";
+        std::cout << "cGen      : " << tGen << " ms (" << bitCode.size() << " bytes)\n";
+        std::cout << "cGenWord  : " << tWord << " ms (" << wordCode.size() << " bytes)\n";
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,52 @@
+// Times Preprocessor::process on a generated program with many masks and
+// mask field references.
+//
+//   g++ -std=c++17 -O2 -I.. preprocess_bench.cpp ../preprocessor.cpp -o preprocess_bench
+//   ./preprocess_bench [masks] [fields per mask] [references]
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "../preprocessor.hpp"
+
+static std::string syntheticSource(int masks, int fields, int refs) {
+    std::string src;
+    for (int m = 0; m < masks; ++m) {
+        src += "mask M" + std::to_string(m) + " {\n";
+        for (int f = 0; f < fields; ++f)
+            src += "    f" + std::to_string(f) + " : " + std::to_string(1 + f % 3) + ";\n";
+        src += "};\n";
+    }
+    src += "function main : " + std::to_string(3 * fields) + " {\n";
+    for (int r = 0; r < refs; ++r) {
+        int m = static_cast<int>((r * 7919LL) % masks);
+        int f = static_cast<int>((r * 104729LL) % fields);
+        src += "    v" + std::to_string(r) + " = main[M" + std::to_string(m) + ".f" + std::to_string(f) + "];\n";
+    }
+    src += "    return main;\n}\n";
+    return src;
+}
+
+int main(int argc, char** argv) {
+    int masks = argc > 1 ? std::atoi(argv[1]) : 200;
+    int fields = argc > 2 ? std::atoi(argv[2]) : 50;
+    int refs = argc > 3 ? std::atoi(argv[3]) : 20000;
+
+    try {
+        std::string src = syntheticSource(masks, fields, refs);
+        auto t0 = std::chrono::steady_clock::now();
+        std::string out = Preprocessor::process(src);
+        auto t1 = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+
+        std::cout << "masks " << masks << " x fields " << fields << ", " << refs << " references\n";
+        std::cout << "source  : " << src.size() << " bytes -> " << out.size() << " bytes\n";
+        std::cout << "process : " << ms << " ms (" << src.size() / 1e3 / ms << " MB/s)\n";
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}
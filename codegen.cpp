@@ -0,0 +1,997 @@
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <stdexcept>
+#include "semantics.hpp"
+
+// Word-level backend. Reachable gates are grouped into blocks of up to 64
+// consecutive gates sharing an operator, and each block is computed as one
+// uint64_t op. Operands and outputs are gathered from input words and block
+// words with one shift and mask per (source word, shift distance) pair, so
+// aligned ranges, slices and rotations cost a handful of instructions instead
+// of one shift-and-OR per bit. Bit positions are MSB-first, matching cGen's
+// byte layout: input bit k sits at position 63 - k % 64 of input word k / 64.
+//
+// Bits moved from one word by many different distances, as in a bit
+// permutation, are routed through a Benes network of delta swaps instead.
+//
+// Adders recorded in wordOps that fit a word are computed with one native + or
+// -, lookups recorded in tableOps read a static const array, and field
+// multiplies recorded in fieldOps use a carry-less multiply (PCLMULQDQ when
+// the CPU has it). Their result bits are leaves of the gate walk, so the
+// carry chains, table circuits and product circuits behind them are never
+// emitted.
+
+namespace {
+
+std::string hexWord(uint64_t v) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "0x%llXULL", static_cast<unsigned long long>(v));
+    return buf;
+}
+
+uint64_t shifted(uint64_t v, int delta) {
+    if (delta >= 64 || delta <= -64) return 0;
+    return delta >= 0 ? v << delta : v >> -delta;
+}
+
+// A Benes network over the 64 bit positions of a word: stage s exchanges bits
+// j and j + benesDistance(s) for every j in its mask, the distance running
+// 32, 16, ..., 1, ..., 16, 32. Any permutation routes through its 11 stages.
+constexpr int BenesStages = 11;
+
+int benesDistance(int s) { return 1 << (s < 6 ? 5 - s : s - 5); }
+
+// perm[o] is the position, relative to base, whose bit must end at o. The
+// outer stages split the block into halves and the looping algorithm picks
+// the half each bit crosses: the two bits of an input pair, and the sources
+// of the two outputs of a pair, always take different halves. Each half is
+// then routed the same way by the stages in between.
+void routeBenes(const std::vector<int>& perm, int base, uint64_t* masks) {
+    int n = static_cast<int>(perm.size());
+    int h = n / 2;
+    int depth = 0;
+    while ((2 << depth) < n) ++depth;
+    int first = 5 - depth, last = 5 + depth;
+    if (n == 2) {
+        if (perm[0] == 1) masks[first] |= 1ULL << base;
+        return;
+    }
+
+    std::vector<int> inv(n), half(n, -1);
+    for (int o = 0; o < n; ++o) inv[perm[o]] = o;
+    for (int start = 0; start < h; ++start)
+        for (int i = start; half[i] < 0; i = perm[inv[i ^ h] ^ h]) {
+            half[i] = 0;
+            half[i ^ h] = 1;
+        }
+
+    std::vector<int> top(h), bottom(h);
+    for (int j = 0; j < h; ++j)
+        if (half[j]) masks[first] |= 1ULL << (base + j);
+    for (int o = 0; o < n; ++o) {
+        int i = perm[o];
+        (half[i] ? bottom : top)[o & (h - 1)] = i & (h - 1);
+        if (o < h && half[i]) masks[last] |= 1ULL << (base + o);
+    }
+    routeBenes(top, base, masks);
+    routeBenes(bottom, base + h, masks);
+}
+
+// Returns the gate driving idx, or nullptr for constants, inputs and undriven
+// placeholder bits.
+const Bit* gateAt(const CompilationContext& cx, int argc, int idx) {
+    if (idx < argc + 2 || idx >= static_cast<int>(cx.bitMapping.size())) return nullptr;
+    const Bit& b = cx.bitMapping[idx];
+    return isGate(b.op) ? &b : nullptr;
+}
+
+// Every gate the outputs depend on, in index order. Operands always get a
+// smaller index than the gate using them, so this is a topological order.
+std::vector<int> reachableGates(const CompilationContext& cx, int argc, const std::vector<int>& out) {
+    std::vector<int> gates;
+    std::vector<int> stack(out.begin(), out.end());
+    std::vector<bool> seen(cx.bitMapping.size(), false);
+    while (!stack.empty()) {
+        int idx = stack.back();
+        stack.pop_back();
+        const Bit* g = gateAt(cx, argc, idx);
+        if (!g || seen[idx]) continue;
+        seen[idx] = true;
+        gates.push_back(idx);
+        stack.push_back(g->lhs);
+        if (g->op != Op::Not) stack.push_back(g->rhs);
+    }
+    std::sort(gates.begin(), gates.end());
+    return gates;
+}
+
+std::string sliceName(const CompilationContext& cx, int argc, int idx) {
+    if (idx >= 2 && idx < argc + 2) return "x" + std::to_string(idx - 2);
+    if (gateAt(cx, argc, idx)) return "g" + std::to_string(idx);
+    return idx == 1 ? "c1" : "c0";
+}
+
+// Body of a bitsliced kernel over lane type T. Bit k of every block lives in
+// in[k * words .. k * words + words), one lane per block; outputs likewise.
+std::string bitslicedBody(const CompilationContext& cx, int argc, const std::vector<int>& out,
+                          const std::vector<int>& gates, const std::string& type, int words) {
+    std::vector<bool> used(argc, false);
+    auto use = [&](int idx) {
+        if (idx >= 2 && idx < argc + 2) used[idx - 2] = true;
+    };
+    for (int idx : gates) {
+        const Bit* g = gateAt(cx, argc, idx);
+        use(g->lhs);
+        if (g->op != Op::Not) use(g->rhs);
+    }
+    for (int idx : out) use(idx);
+
+    std::string code;
+    code += "    const " + type + " c0 = {0};\n";
+    code += "    const " + type + " c1 = ~c0;\n";
+    code += "    (void)c0; (void)c1;\n";
+    for (int k = 0; k < argc; ++k) {
+        if (!used[k]) continue;
+        std::string x = "x" + std::to_string(k);
+        code += "    " + type + " " + x + "; memcpy(&" + x + ", in + " + std::to_string(k * words) +
+                ", sizeof " + x + ");\n";
+    }
+    for (int idx : gates) {
+        const Bit* g = gateAt(cx, argc, idx);
+        std::string e = g->op == Op::Not
+            ? "~" + sliceName(cx, argc, g->lhs)
+            : sliceName(cx, argc, g->lhs) + " " + opSymbol(g->op) + " " + sliceName(cx, argc, g->rhs);
+        code += "    const " + type + " g" + std::to_string(idx) + " = " + e + ";\n";
+    }
+    for (size_t i = 0; i < out.size(); ++i) {
+        std::string v = sliceName(cx, argc, out[i]);
+        code += "    memcpy(out + " + std::to_string(i * words) + ", &" + v + ", sizeof " + v + ");\n";
+    }
+    return code;
+}
+
+struct Word {
+    std::string name;
+    uint64_t layout = 0;  // positions holding a bit
+    bool clean = true;    // every other position is zero
+};
+
+struct Home {
+    int word;
+    int pos;
+};
+
+// How many times a product of two elements of GF(2^n) modulo x^n + r must be
+// folded, replacing c * x^n by c * r, until it is below x^n.
+int fieldFolds(int n, uint64_t r) {
+    int d = 0;
+    while (d < 63 && (r >> (d + 1))) ++d;
+    int folds = 0;
+    for (int top = 2 * n - 2; top >= n; top -= n - d) ++folds;
+    return folds;
+}
+
+// An adder, table lookup or field multiply recorded by the analyzer and
+// computed directly instead of through its gates. It is emitted once the walk
+// passes fire, its last operand or claimed result bit.
+struct NativeOp {
+    const WordOp* word = nullptr;
+    const TableOp* table = nullptr;
+    const FieldOp* field = nullptr;
+    std::vector<int> operands;
+    const std::vector<int>* result = nullptr;
+    int fire = -1;
+};
+
+class WordGen {
+public:
+    WordGen(const CompilationContext& cx, const std::string& name, int argc, const std::vector<int>& out);
+
+    // bits[i].first lands at position bits[i].second of the result.
+    std::string gather(const std::vector<std::pair<int, int>>& bits);
+    std::string permute(int word, const std::vector<std::pair<int, int>>& moves, int groups);
+
+    std::string tables;   // lookup arrays, emitted ahead of the function
+    std::string loads;
+    std::string body;
+
+private:
+    const CompilationContext& cx;
+    std::string fn;
+    int inpBits;
+    int inpBytes;
+    std::vector<Word> words;
+    std::vector<bool> loaded;
+    std::unordered_map<int, Home> homes;
+    std::vector<NativeOp> natives;
+    std::unordered_map<int, int> owner;   // result bit -> index into natives
+    std::unordered_set<const TableDecl*> tablesEmitted;
+    int permuted = 0;
+
+    const Bit* gate(int idx) const;
+    const std::string& use(int word);
+    std::vector<int> plan(const std::vector<int>& out, std::vector<int>& order);
+    void emitNative(int k);
+    bool home(int idx, Home& h) const;
+    int wordOf(int idx) const;
+    bool inherit(const std::vector<int>& block, bool useLhs, std::vector<int>& pos) const;
+    void emitBlock(const std::vector<int>& block);
+};
+
+WordGen::WordGen(const CompilationContext& cx, const std::string& name, int argc, const std::vector<int>& out)
+    : cx(cx), fn(name), inpBits(argc), inpBytes((argc + 7) / 8) {
+    for (int j = 0; j * 64 < inpBits; ++j) {
+        int count = std::min(64, inpBits - j * 64);
+        Word w;
+        w.name = "i" + std::to_string(j);
+        w.layout = count == 64 ? ~0ULL : ~(~0ULL >> count);
+        w.clean = count % 8 == 0;
+        words.push_back(w);
+    }
+    loaded.assign(words.size(), false);
+
+    for (const WordOp& op : cx.wordOps) {
+        NativeOp n;
+        n.word = &op;
+        n.operands = op.lhs;
+        n.operands.insert(n.operands.end(), op.rhs.begin(), op.rhs.end());
+        n.result = &op.sum;
+        if (op.sum.size() <= 64) natives.push_back(std::move(n));
+    }
+    for (const TableOp& op : cx.tableOps) {
+        NativeOp n;
+        n.table = &op;
+        n.operands = op.in;
+        n.result = &op.out;
+        natives.push_back(std::move(n));
+    }
+    for (const FieldOp& op : cx.fieldOps) {
+        NativeOp n;
+        n.field = &op;
+        n.operands = op.lhs;
+        n.operands.insert(n.operands.end(), op.rhs.begin(), op.rhs.end());
+        n.result = &op.out;
+        natives.push_back(std::move(n));
+    }
+
+    std::vector<int> order;
+    std::vector<int> gates = plan(out, order);
+
+    size_t i = 0, next = 0;
+    auto fireOf = [&](size_t k) { return natives[order[k]].fire; };
+    while (i < gates.size()) {
+        while (next < order.size() && fireOf(next) < gates[i]) emitNative(order[next++]);
+        int start = gates[i];
+        const Bit* first = gate(start);
+        int lhsWord = wordOf(first->lhs);
+        size_t j = i + 1;
+        while (j < gates.size() && j - i < 64 && gates[j] == gates[j - 1] + 1) {
+            const Bit* g = gate(gates[j]);
+            if (g->op != first->op) break;
+            if (g->lhs >= start || (g->op != Op::Not && g->rhs >= start)) break;
+            if (wordOf(g->lhs) != lhsWord) break;
+            if (next < order.size() && gates[j] > fireOf(next)) break;
+            ++j;
+        }
+        emitBlock(std::vector<int>(gates.begin() + i, gates.begin() + j));
+        i = j;
+    }
+    while (next < order.size()) emitNative(order[next++]);
+}
+
+// Picks the natives to compute directly and returns the gates still needed,
+// in index order. A native only claims the result bits built after all of its
+// operands; an earlier one is a gate from elsewhere that simplification
+// showed equal to the result. Every reader of a claimed bit must come after
+// the native's fire point; one that some reader precedes falls back to its
+// gates.
+std::vector<int> WordGen::plan(const std::vector<int>& out, std::vector<int>& order) {
+    std::vector<bool> enabled(natives.size());
+    for (size_t k = 0; k < natives.size(); ++k) {
+        const std::vector<int>& ops = natives[k].operands;
+        enabled[k] = !ops.empty() && std::none_of(ops.begin(), ops.end(), [](int b) { return b < 0; });
+    }
+
+    for (;;) {
+        owner.clear();
+        for (size_t k = 0; k < natives.size(); ++k) {
+            if (!enabled[k]) continue;
+            const NativeOp& n = natives[k];
+            int last = *std::max_element(n.operands.begin(), n.operands.end());
+            for (int r : *n.result)
+                if (r > last && gate(r)) owner.emplace(r, static_cast<int>(k));
+        }
+
+        std::vector<int> gates;
+        std::vector<bool> seen(cx.bitMapping.size(), false), used(natives.size(), false);
+        std::vector<int> stack(out.begin(), out.end());
+        while (!stack.empty()) {
+            int idx = stack.back();
+            stack.pop_back();
+            const Bit* g = gate(idx);
+            if (!g || seen[idx]) continue;
+            seen[idx] = true;
+            auto it = owner.find(idx);
+            if (it != owner.end()) {
+                if (!used[it->second]) {
+                    used[it->second] = true;
+                    const std::vector<int>& ops = natives[it->second].operands;
+                    stack.insert(stack.end(), ops.begin(), ops.end());
+                }
+                continue;
+            }
+            gates.push_back(idx);
+            stack.push_back(g->lhs);
+            if (g->op != Op::Not) stack.push_back(g->rhs);
+        }
+        std::sort(gates.begin(), gates.end());
+
+        for (size_t k = 0; k < natives.size(); ++k) {
+            NativeOp& n = natives[k];
+            if (!used[k]) continue;
+            n.fire = *std::max_element(n.operands.begin(), n.operands.end());
+            for (int r : *n.result) {
+                auto it = owner.find(r);
+                if (it != owner.end() && it->second == static_cast<int>(k)) n.fire = std::max(n.fire, r);
+            }
+        }
+
+        bool ok = true;
+        auto check = [&](int read, int at) {
+            auto it = owner.find(read);
+            if (it != owner.end() && at <= natives[it->second].fire) {
+                enabled[it->second] = false;
+                ok = false;
+            }
+        };
+        for (int idx : gates) {
+            const Bit* g = gate(idx);
+            check(g->lhs, idx);
+            if (g->op != Op::Not) check(g->rhs, idx);
+        }
+        for (size_t k = 0; k < natives.size(); ++k)
+            if (used[k])
+                for (int b : natives[k].operands) check(b, natives[k].fire);
+        if (!ok) continue;
+
+        order.clear();
+        for (size_t k = 0; k < natives.size(); ++k)
+            if (used[k]) order.push_back(static_cast<int>(k));
+        std::stable_sort(order.begin(), order.end(),
+                         [&](int a, int b) { return natives[a].fire < natives[b].fire; });
+        return gates;
+    }
+}
+
+// Results are placed at the top of the word. An adder's operands go there
+// too, so the low positions add to zero and the carry out of position 63 is
+// dropped: the result is exactly the n-bit sum, already clean. A table index
+// is gathered into the low bits and the entry shifted up. Field elements are
+// gathered into the low bits as polynomials, x^0 at position 0; one wider
+// than 64 bits is split into a low and a high word, and so is its product,
+// which then fills two result words.
+void WordGen::emitNative(int k) {
+    const NativeOp& n = natives[k];
+    int width = static_cast<int>(n.result->size());
+    std::string w = "w" + std::to_string(words.size() - loaded.size());
+
+    std::vector<std::string> results;
+    if (n.word) {
+        std::vector<std::pair<int, int>> lhs, rhs;
+        for (int i = 0; i < width; ++i) {
+            lhs.emplace_back(n.word->lhs[i], 63 - i);
+            rhs.emplace_back(n.word->rhs[i], 63 - i);
+        }
+        results.push_back(gather(lhs) + (n.word->kind == WordOpKind::Add ? " + " : " - ") + gather(rhs));
+    } else if (n.table) {
+        const TableDecl* t = n.table->table;
+        std::string array = fn + "_" + t->name;
+        if (tablesEmitted.insert(t).second) {
+            int bits = t->outBits <= 8 ? 8 : t->outBits <= 16 ? 16 : t->outBits <= 32 ? 32 : 64;
+            size_t count = size_t{1} << t->inBits;
+            tables += "static const uint" + std::to_string(bits) + "_t " + array + "[" + std::to_string(count) + "] = {";
+            for (size_t i = 0; i < count; ++i) {
+                if (i % 8 == 0) tables += "\n   ";
+                char buf[24];
+                std::snprintf(buf, sizeof buf, " 0x%llX,", static_cast<unsigned long long>(t->entries[i]));
+                tables += buf;
+            }
+            tables += "\n};\n\n";
+        }
+        std::vector<std::pair<int, int>> index;
+        for (int i = 0; i < t->inBits; ++i) index.emplace_back(n.table->in[i], t->inBits - 1 - i);
+        std::string e = "(uint64_t)" + array + "[" + gather(index) + "]";
+        if (width < 64) e += " << " + std::to_string(64 - width);
+        results.push_back(e);
+    } else {
+        const FieldDecl* f = n.field->field;
+        std::string args = hexWord(f->poly) + ", " + std::to_string(width) + ", " +
+                           std::to_string(fieldFolds(width, f->poly));
+        // Element words, low first: coefficient c of x^c sits at position
+        // c % 64 of word c / 64.
+        auto element = [&](const std::vector<int>& bits) {
+            std::vector<std::pair<int, int>> part[2];
+            for (int i = 0; i < width; ++i) {
+                int c = width - 1 - i;
+                part[c / 64].emplace_back(bits[i], c % 64);
+            }
+            std::vector<std::string> e{gather(part[0])};
+            if (width > 64) e.push_back(gather(part[1]));
+            return e;
+        };
+        std::vector<std::string> a = element(n.field->lhs), b = element(n.field->rhs);
+        if (width <= 64) {
+            std::string e = "bs_gfmul(" + a[0] + ", " + b[0] + ", " + args + ")";
+            if (width < 64) e += " << " + std::to_string(64 - width);
+            results.push_back(e);
+        } else {
+            int s = width - 64;
+            body += "    uint64_t " + w + "a[2] = {" + a[0] + ", " + a[1] + "};\n";
+            body += "    uint64_t " + w + "b[2] = {" + b[0] + ", " + b[1] + "};\n";
+            body += "    uint64_t " + w + "p[2];\n";
+            body += "    bs_gfmul128(" + w + "a, " + w + "b, " + args + ", " + w + "p);\n";
+            if (s == 64) {
+                results.push_back(w + "p[1]");
+                results.push_back(w + "p[0]");
+            } else {
+                results.push_back("(" + w + "p[1] << " + std::to_string(64 - s) + ") | (" + w + "p[0] >> " +
+                                  std::to_string(s) + ")");
+                results.push_back(w + "p[0] << " + std::to_string(64 - s));
+            }
+        }
+    }
+
+    for (size_t r = 0; r < results.size(); ++r) {
+        int bits = std::min(64, width - static_cast<int>(r) * 64);
+        Word word;
+        word.name = "w" + std::to_string(words.size() - loaded.size());
+        word.layout = bits == 64 ? ~0ULL : ~(~0ULL >> bits);
+        body += "    const uint64_t " + word.name + " = " + results[r] + ";\n";
+
+        int id = static_cast<int>(words.size());
+        words.push_back(word);
+        for (int i = static_cast<int>(r) * 64; i < static_cast<int>(r) * 64 + bits; ++i) {
+            auto it = owner.find((*n.result)[i]);
+            if (it != owner.end() && it->second == k) homes[(*n.result)[i]] = Home{id, 63 - i % 64};
+        }
+    }
+}
+
+const Bit* WordGen::gate(int idx) const {
+    return gateAt(cx, inpBits, idx);
+}
+
+// Constants and undriven placeholder bits have no home.
+bool WordGen::home(int idx, Home& h) const {
+    if (idx >= 2 && idx < inpBits + 2) {
+        int k = idx - 2;
+        h = Home{k / 64, 63 - k % 64};
+        return true;
+    }
+    auto it = homes.find(idx);
+    if (it == homes.end()) return false;
+    h = it->second;
+    return true;
+}
+
+int WordGen::wordOf(int idx) const {
+    Home h;
+    return home(idx, h) ? h.word : -1;
+}
+
+// Places every gate of the block at the position of its operand when all the
+// operands live in one word, so that operand needs no shifting at all.
+bool WordGen::inherit(const std::vector<int>& block, bool useLhs, std::vector<int>& pos) const {
+    uint64_t taken = 0;
+    int word = -1;
+    pos.clear();
+    for (int idx : block) {
+        const Bit* g = gate(idx);
+        if (!useLhs && g->op == Op::Not) return false;
+        Home h;
+        if (!home(useLhs ? g->lhs : g->rhs, h)) return false;
+        if (word != -1 && h.word != word) return false;
+        if (taken & (1ULL << h.pos)) return false;
+        word = h.word;
+        taken |= 1ULL << h.pos;
+        pos.push_back(h.pos);
+    }
+    return true;
+}
+
+void WordGen::emitBlock(const std::vector<int>& block) {
+    std::vector<int> pos;
+    if (!inherit(block, true, pos) && !inherit(block, false, pos)) {
+        pos.clear();
+        for (size_t i = 0; i < block.size(); ++i) pos.push_back(63 - static_cast<int>(i));
+    }
+
+    Word w;
+    w.name = "w" + std::to_string(words.size() - loaded.size());
+    std::vector<std::pair<int, int>> lhs, rhs;
+    for (size_t i = 0; i < block.size(); ++i) {
+        const Bit* g = gate(block[i]);
+        w.layout |= 1ULL << pos[i];
+        lhs.emplace_back(g->lhs, pos[i]);
+        rhs.emplace_back(g->rhs, pos[i]);
+    }
+
+    Op op = gate(block[0])->op;
+    std::string e;
+    if (op == Op::Not) e = "~" + gather(lhs) + " & " + hexWord(w.layout);
+    else e = gather(lhs) + " " + opSymbol(op) + " " + gather(rhs);
+    body += "    const uint64_t " + w.name + " = " + e + ";\n";
+
+    int id = static_cast<int>(words.size());
+    words.push_back(w);
+    for (size_t i = 0; i < block.size(); ++i) homes[block[i]] = Home{id, pos[i]};
+}
+
+// Names a word for reading, loading it from the input first if it is an input
+// word not read so far.
+const std::string& WordGen::use(int word) {
+    const Word& w = words[word];
+    if (word < static_cast<int>(loaded.size()) && !loaded[word]) {
+        int byte = word * 8;
+        std::string load = byte + 8 <= inpBytes
+            ? "bs_load64(in + " + std::to_string(byte) + ")"
+            : "bs_loadn(in + " + std::to_string(byte) + ", " + std::to_string(inpBytes - byte) + ")";
+        loads += "    const uint64_t " + w.name + " = " + load + ";\n";
+        loaded[word] = true;
+    }
+    return w.name;
+}
+
+// Bits of one word that would otherwise take one shift-and-mask term per
+// distance. When routing them through a Benes network costs fewer
+// instructions (about 6 per stage used against 3 per term), the network is
+// emitted into body and its masked result returned; otherwise "".
+std::string WordGen::permute(int word, const std::vector<std::pair<int, int>>& moves, int groups) {
+    std::vector<int> perm(64, -1);
+    std::vector<bool> taken(64, false);
+    uint64_t mask = 0;
+    for (auto& m : moves) {
+        if (taken[m.first]) return "";   // a bit read twice is not a permutation
+        taken[m.first] = true;
+        perm[m.second] = m.first;
+        mask |= 1ULL << m.second;
+    }
+    int spare = 0;
+    for (int& p : perm) {
+        if (p >= 0) continue;
+        while (taken[spare]) ++spare;
+        taken[spare] = true;
+        p = spare;
+    }
+
+    uint64_t masks[BenesStages] = {};
+    routeBenes(perm, 0, masks);
+    int stages = static_cast<int>(std::count_if(masks, masks + BenesStages, [](uint64_t m) { return m != 0; }));
+    if (6 * stages + 1 >= 3 * groups) return "";
+
+    std::string p = "p" + std::to_string(permuted++);
+    body += "    uint64_t " + p + " = " + use(word) + ";\n";
+    for (int st = 0; st < BenesStages; ++st)
+        if (masks[st])
+            body += "    " + p + " = bs_dswap(" + p + ", " + hexWord(masks[st]) + ", " + std::to_string(benesDistance(st)) + ");\n";
+    return mask == ~0ULL ? p : "(" + p + " & " + hexWord(mask) + ")";
+}
+
+std::string WordGen::gather(const std::vector<std::pair<int, int>>& bits) {
+    struct Group {
+        int word;
+        int delta;
+        uint64_t mask;
+    };
+    std::vector<Group> groups;
+    std::unordered_map<int, std::vector<std::pair<int, int>>> moves;   // word -> (from, to)
+    uint64_t ones = 0;
+
+    for (auto& b : bits) {
+        Home h;
+        if (!home(b.first, h)) {
+            if (b.first == 1) ones |= 1ULL << b.second;
+            continue;
+        }
+        moves[h.word].emplace_back(h.pos, b.second);
+        int delta = b.second - h.pos;
+        auto g = std::find_if(groups.begin(), groups.end(),
+                              [&](const Group& x) { return x.word == h.word && x.delta == delta; });
+        if (g == groups.end()) groups.push_back(Group{h.word, delta, 1ULL << b.second});
+        else g->mask |= 1ULL << b.second;
+    }
+
+    std::vector<std::string> terms;
+    std::unordered_map<int, bool> routed;
+    for (auto& g : groups) {
+        auto r = routed.find(g.word);
+        if (r == routed.end()) {
+            int count = static_cast<int>(std::count_if(groups.begin(), groups.end(),
+                                                       [&](const Group& x) { return x.word == g.word; }));
+            std::string t = count > 3 ? permute(g.word, moves[g.word], count) : "";
+            r = routed.emplace(g.word, !t.empty()).first;
+            if (!t.empty()) terms.push_back(t);
+        }
+        if (r->second) continue;
+
+        const Word& w = words[g.word];
+        std::string t = use(g.word);
+        if (g.delta > 0) t = "(" + t + " << " + std::to_string(g.delta) + ")";
+        if (g.delta < 0) t = "(" + t + " >> " + std::to_string(-g.delta) + ")";
+        if (!w.clean || shifted(w.layout, g.delta) != g.mask) t = "(" + t + " & " + hexWord(g.mask) + ")";
+        terms.push_back(t);
+    }
+    if (ones || terms.empty()) terms.push_back(hexWord(ones));
+
+    if (terms.size() == 1) return terms[0];
+    std::string e = "(" + terms[0];
+    for (size_t i = 1; i < terms.size(); ++i) e += " | " + terms[i];
+    return e + ")";
+}
+
+// name_batch runs name over n records packed back to back. The kernels keep
+// no state between calls, so an OpenMP build splits the records across
+// threads.
+std::string batchEntry(const std::string& name, int inBytes, int outBytes) {
+    std::string code;
+    code += "void " + name + "_batch(const uint8_t* in, uint8_t* out, size_t n) {\n";
+    code += "#ifdef _OPENMP\n";
+    code += "#pragma omp parallel for schedule(static)\n";
+    code += "#endif\n";
+    code += "    for (long long i = 0; i < (long long)n; i++)\n";
+    code += "        " + name + "(in + (size_t)i * " + std::to_string(inBytes) + ", out + (size_t)i * " +
+            std::to_string(outBytes) + ");\n";
+    code += "}\n";
+    return code;
+}
+
+} // namespace
+
+// Per-bit backend. Every reachable gate is evaluated once, in topological
+// order, into a 0/1 temporary; gates the outputs do not depend on are
+// dropped. Output bytes are then assembled from those temporaries.
+//
+// Unless unrollLoops is set, each recorded repeat loop becomes a C loop: its
+// exit bits are read from the loop's state array instead of being computed
+// through the unrolled iterations, and the kernel is emitted once.
+std::string SemanticAnalyzer::cGen(const std::string& name, std::vector<int> out, bool unrollLoops) {
+    int inpBits = mainArgc();
+    int outBytes = (static_cast<int>(out.size()) + 7) / 8;
+
+    struct Leaf {
+        int loop;
+        int pos;
+    };
+    std::unordered_map<int, Leaf> leaves;
+    if (!unrollLoops) {
+        for (size_t r = 0; r < cx.loopRegions.size(); ++r) {
+            const LoopRegion& loop = cx.loopRegions[r];
+            for (size_t j = 0; j < loop.exit.size(); ++j) {
+                int idx = loop.exit[j];
+                if (idx >= loop.firstNode && idx < loop.endNode && gateAt(cx, inpBits, idx))
+                    leaves.emplace(idx, Leaf{static_cast<int>(r), static_cast<int>(j)});
+            }
+        }
+    }
+
+    std::vector<int> gates;
+    std::vector<bool> loopUsed(cx.loopRegions.size(), false);
+    std::vector<bool> seen(cx.bitMapping.size(), false);
+    std::vector<int> stack(out.begin(), out.end());
+    while (!stack.empty()) {
+        int idx = stack.back();
+        stack.pop_back();
+        if (idx < 0 || idx >= static_cast<int>(seen.size()) || seen[idx]) continue;
+        seen[idx] = true;
+        auto leaf = leaves.find(idx);
+        if (leaf != leaves.end()) {
+            const LoopRegion& loop = cx.loopRegions[leaf->second.loop];
+            if (!loopUsed[leaf->second.loop]) stack.insert(stack.end(), loop.entry.begin(), loop.entry.end());
+            loopUsed[leaf->second.loop] = true;
+            continue;
+        }
+        const Bit* g = gateAt(cx, inpBits, idx);
+        if (!g) continue;
+        gates.push_back(idx);
+        stack.push_back(g->lhs);
+        if (g->op != Op::Not) stack.push_back(g->rhs);
+    }
+    std::sort(gates.begin(), gates.end());
+
+    std::vector<bool> used(inpBits, false);
+    auto bit = [&](int idx) -> std::string {
+        if (idx >= 2 && idx < inpBits + 2) {
+            used[idx - 2] = true;
+            return "x" + std::to_string(idx - 2);
+        }
+        auto leaf = leaves.find(idx);
+        if (leaf != leaves.end())
+            return "l" + std::to_string(leaf->second.loop) + "[" + std::to_string(leaf->second.pos) + "]";
+        if (gateAt(cx, inpBits, idx)) return "g" + std::to_string(idx);
+        return idx == 1 ? "1" : "0";
+    };
+
+    auto emitLoop = [&](int r) {
+        const LoopRegion& loop = cx.loopRegions[r];
+        const FunctionSummary& kernel = loop.kernel;
+        std::string l = "l" + std::to_string(r);
+        std::string width = std::to_string(std::max<size_t>(loop.entry.size(), 1));
+        auto ref = [&](int enc) -> std::string {
+            if (enc < 0) return l + "[" + std::to_string(loop.stateOfSymbol[-enc - 1]) + "]";
+            if (enc >= 2) return isGate(kernel.nodes[enc - 2].op) ? l + "_k" + std::to_string(enc - 2) : "0";
+            return enc == 1 ? "1" : "0";
+        };
+
+        std::string code = "    unsigned char " + l + "[" + width + "];\n";
+        for (size_t j = 0; j < loop.entry.size(); ++j)
+            code += "    " + l + "[" + std::to_string(j) + "] = " + bit(loop.entry[j]) + ";\n";
+        code += "    for (int it = 0; it < " + std::to_string(loop.count) + "; it++) {\n";
+        code += "        unsigned char " + l + "_n[" + width + "];\n";
+        for (size_t k = 0; k < kernel.nodes.size(); ++k) {
+            const Bit& g = kernel.nodes[k];
+            if (!isGate(g.op)) continue;
+            std::string e = g.op == Op::Not
+                ? ref(g.lhs) + " ^ 1"
+                : ref(g.lhs) + " " + opSymbol(g.op) + " " + ref(g.rhs);
+            code += "        const unsigned char " + l + "_k" + std::to_string(k) + " = " + e + ";\n";
+        }
+        int j = 0;
+        for (auto& v : kernel.vars)
+            for (int enc : v.second)
+                code += "        " + l + "_n[" + std::to_string(j++) + "] = " + ref(enc) + ";\n";
+        code += "        for (int j = 0; j < " + std::to_string(loop.entry.size()) + "; j++) " + l + "[j] = " + l + "_n[j];\n";
+        code += "    }\n";
+        return code;
+    };
+
+    std::string body;
+    size_t nextLoop = 0;
+    auto emitLoopsBefore = [&](int idx) {
+        for (; nextLoop < cx.loopRegions.size() && cx.loopRegions[nextLoop].firstNode <= idx; ++nextLoop)
+            if (loopUsed[nextLoop]) body += emitLoop(static_cast<int>(nextLoop));
+    };
+    for (int idx : gates) {
+        emitLoopsBefore(idx);
+        const Bit* g = gateAt(cx, inpBits, idx);
+        std::string e = g->op == Op::Not
+            ? bit(g->lhs) + " ^ 1"
+            : bit(g->lhs) + " " + opSymbol(g->op) + " " + bit(g->rhs);
+        body += "    const unsigned char g" + std::to_string(idx) + " = " + e + ";\n";
+    }
+    emitLoopsBefore(static_cast<int>(cx.bitMapping.size()));
+
+    std::string stores;
+    for (int byte = 0; byte < outBytes; ++byte) {
+        std::string value;
+        for (int i = byte * 8; i < byte * 8 + 8 && i < static_cast<int>(out.size()); ++i) {
+            std::string b = bit(out[i]);
+            if (b == "0") continue;
+            int shift = 7 - i % 8;
+            std::string term = b == "1" ? std::to_string(1 << shift)
+                                        : (shift ? "(" + b + " << " + std::to_string(shift) + ")" : b);
+            value += value.empty() ? term : " | " + term;
+        }
+        if (value.empty()) value = "0";
+        stores += "    out[" + std::to_string(byte) + "] = (uint8_t)(" + value + ");\n";
+    }
+
+    std::string code = "#include <stddef.h>\n";
+    code += "#include <stdint.h>\n\n";
+    code += "void " + name + "(const uint8_t* in, uint8_t* out) {\n";
+    for (int k = 0; k < inpBits; ++k) {
+        if (!used[k]) continue;
+        code += "    const unsigned char x" + std::to_string(k) + " = (in[" + std::to_string(k / 8) +
+                "] >> " + std::to_string(7 - k % 8) + ") & 1;\n";
+    }
+    code += body;
+    code += stores;
+    code += "}\n\n";
+    code += batchEntry(name, (inpBits + 7) / 8, outBytes);
+
+    return code;
+}
+
+std::string SemanticAnalyzer::cGenWord(const std::string& name, const std::vector<int>& out) {
+    int inpBits = mainArgc();
+    int outBytes = (static_cast<int>(out.size()) + 7) / 8;
+    int segments = (static_cast<int>(out.size()) + 63) / 64;
+
+    WordGen gen(cx, name, inpBits, out);
+    std::string stores;
+    for (int s = 0; s < segments; ++s) {
+        std::vector<std::pair<int, int>> bits;
+        for (size_t i = s * 64; i < out.size() && i < static_cast<size_t>(s + 1) * 64; ++i)
+            bits.emplace_back(out[i], 63 - static_cast<int>(i % 64));
+        std::string at = "out + " + std::to_string(s * 8);
+        stores += (s + 1) * 8 <= outBytes
+            ? "    bs_store64(" + at + ", " + gen.gather(bits) + ");\n"
+            : "    bs_storen(" + at + ", " + gen.gather(bits) + ", " + std::to_string(outBytes - s * 8) + ");\n";
+    }
+
+    std::string code;
+    code += "#ifndef BITSMITH_WORD_HELPERS\n";
+    code += "#define BITSMITH_WORD_HELPERS\n";
+    code += "#include <stddef.h>\n";
+    code += "#include <stdint.h>\n";
+    code += "#include <string.h>\n";
+    code += "#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__\n";
+    code += "static inline uint64_t bs_load64(const unsigned char* p) {\n";
+    code += "    uint64_t v;\n";
+    code += "    memcpy(&v, p, 8);\n";
+    code += "    return __builtin_bswap64(v);\n";
+    code += "}\n";
+    code += "static inline uint64_t bs_loadn(const unsigned char* p, size_t n) {\n";
+    code += "    uint64_t v = 0;\n";
+    code += "    memcpy(&v, p, n);\n";
+    code += "    return __builtin_bswap64(v);\n";
+    code += "}\n";
+    code += "static inline void bs_store64(unsigned char* p, uint64_t v) {\n";
+    code += "    v = __builtin_bswap64(v);\n";
+    code += "    memcpy(p, &v, 8);\n";
+    code += "}\n";
+    code += "static inline void bs_storen(unsigned char* p, uint64_t v, size_t n) {\n";
+    code += "    v = __builtin_bswap64(v);\n";
+    code += "    memcpy(p, &v, n);\n";
+    code += "}\n";
+    code += "#else\n";
+    code += "static inline uint64_t bs_load64(const unsigned char* p) {\n";
+    code += "    return ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) | ((uint64_t)p[2] << 40) |\n";
+    code += "           ((uint64_t)p[3] << 32) | ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) |\n";
+    code += "           ((uint64_t)p[6] << 8) | (uint64_t)p[7];\n";
+    code += "}\n";
+    code += "static inline uint64_t bs_loadn(const unsigned char* p, size_t n) {\n";
+    code += "    uint64_t v = 0;\n";
+    code += "    for (size_t i = 0; i < 8; i++) v = (v << 8) | (i < n ? p[i] : 0);\n";
+    code += "    return v;\n";
+    code += "}\n";
+    code += "static inline void bs_store64(unsigned char* p, uint64_t v) {\n";
+    code += "    for (int i = 7; i >= 0; i--) { p[i] = (unsigned char)v; v >>= 8; }\n";
+    code += "}\n";
+    code += "static inline void bs_storen(unsigned char* p, uint64_t v, size_t n) {\n";
+    code += "    for (size_t i = 0; i < n; i++) p[i] = (unsigned char)(v >> (56 - 8 * i));\n";
+    code += "}\n";
+    code += "#endif\n";
+    code += "static inline uint64_t bs_dswap(uint64_t x, uint64_t m, int d) {\n";
+    code += "    uint64_t t = ((x >> d) ^ x) & m;\n";
+    code += "    return x ^ t ^ (t << d);\n";
+    code += "}\n";
+    code += "#if defined(__GNUC__) && defined(__x86_64__)\n";
+    code += "#define BITSMITH_PCLMUL 1\n";
+    code += "#include <wmmintrin.h>\n";
+    code += "__attribute__((target(\"pclmul,sse2\")))\n";
+    code += "static inline void bs_clmul_pclmul(uint64_t a, uint64_t b, uint64_t* hi, uint64_t* lo) {\n";
+    code += "    __m128i p = _mm_clmulepi64_si128(_mm_cvtsi64_si128((long long)a), _mm_cvtsi64_si128((long long)b), 0);\n";
+    code += "    *lo = (uint64_t)_mm_cvtsi128_si64(p);\n";
+    code += "    *hi = (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(p, p));\n";
+    code += "}\n";
+    code += "static inline int bs_has_pclmul(void) {\n";
+    code += "    return __builtin_cpu_supports(\"pclmul\") != 0;\n";
+    code += "}\n";
+    code += "#endif\n";
+    code += "/* 128-bit carry-less product of a and b. The portable loop has no\n";
+    code += "   data-dependent branches. */\n";
+    code += "static inline void bs_clmul(uint64_t a, uint64_t b, uint64_t* hi, uint64_t* lo) {\n";
+    code += "#ifdef BITSMITH_PCLMUL\n";
+    code += "    if (bs_has_pclmul()) {\n";
+    code += "        bs_clmul_pclmul(a, b, hi, lo);\n";
+    code += "        return;\n";
+    code += "    }\n";
+    code += "#endif\n";
+    code += "    uint64_t h = 0, l = 0;\n";
+    code += "    for (int i = 0; i < 64; i++) {\n";
+    code += "        uint64_t m = 0 - ((b >> i) & 1);\n";
+    code += "        l ^= (a << i) & m;\n";
+    code += "        if (i) h ^= (a >> (64 - i)) & m;\n";
+    code += "    }\n";
+    code += "    *hi = h;\n";
+    code += "    *lo = l;\n";
+    code += "}\n";
+    code += "/* a * b in GF(2^n) modulo x^n + r, n <= 64: the product's part from x^n\n";
+    code += "   up is folded back down as part * r, folds times. */\n";
+    code += "static inline uint64_t bs_gfmul(uint64_t a, uint64_t b, uint64_t r, int n, int folds) {\n";
+    code += "    uint64_t hi, lo, mask = n == 64 ? ~0ULL : (1ULL << n) - 1;\n";
+    code += "    bs_clmul(a, b, &hi, &lo);\n";
+    code += "    for (int f = 0; f < folds; f++) {\n";
+    code += "        uint64_t top = n == 64 ? hi : (hi << (64 - n)) | (lo >> n);\n";
+    code += "        uint64_t low = lo & mask;\n";
+    code += "        bs_clmul(top, r, &hi, &lo);\n";
+    code += "        lo ^= low;\n";
+    code += "    }\n";
+    code += "    return lo;\n";
+    code += "}\n";
+    code += "/* The same for 64 < n <= 128, on elements split into words low first. */\n";
+    code += "static inline void bs_gfmul128(const uint64_t* a, const uint64_t* b, uint64_t r, int n, int folds, uint64_t* out) {\n";
+    code += "    uint64_t p[4] = {0, 0, 0, 0}, hi, lo;\n";
+    code += "    int s = n - 64;\n";
+    code += "    for (int i = 0; i < 2; i++)\n";
+    code += "        for (int j = 0; j < 2; j++) {\n";
+    code += "            bs_clmul(a[i], b[j], &hi, &lo);\n";
+    code += "            p[i + j] ^= lo;\n";
+    code += "            p[i + j + 1] ^= hi;\n";
+    code += "        }\n";
+    code += "    for (int f = 0; f < folds; f++) {\n";
+    code += "        uint64_t t0 = s == 64 ? p[2] : (p[1] >> s) | (p[2] << (64 - s));\n";
+    code += "        uint64_t t1 = s == 64 ? p[3] : (p[2] >> s) | (p[3] << (64 - s));\n";
+    code += "        if (s < 64) p[1] &= (1ULL << s) - 1;\n";
+    code += "        p[2] = p[3] = 0;\n";
+    code += "        bs_clmul(t0, r, &hi, &lo);\n";
+    code += "        p[0] ^= lo;\n";
+    code += "        p[1] ^= hi;\n";
+    code += "        bs_clmul(t1, r, &hi, &lo);\n";
+    code += "        p[1] ^= lo;\n";
+    code += "        p[2] ^= hi;\n";
+    code += "    }\n";
+    code += "    out[0] = p[0];\n";
+    code += "    out[1] = p[1];\n";
+    code += "}\n";
+    code += "#endif\n\n";
+
+    code += gen.tables;
+    code += "void " + name + "(const uint8_t* in, uint8_t* out) {\n";
+    code += gen.loads;
+    code += gen.body;
+    code += stores;
+    code += "}\n\n";
+    code += batchEntry(name, (inpBits + 7) / 8, outBytes);
+
+    return code;
+}
+
+std::string SemanticAnalyzer::cGenBitsliced(const std::string& name, const std::vector<int>& out) {
+    int inpBits = mainArgc();
+    std::vector<int> gates = reachableGates(cx, inpBits, out);
+    std::string fn = name + "_bitsliced";
+
+    std::string code;
+    code += "#ifndef BITSMITH_BITSLICE_HELPERS\n";
+    code += "#define BITSMITH_BITSLICE_HELPERS\n";
+    code += "#include <stdint.h>\n";
+    code += "#include <string.h>\n";
+    code += "#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))\n";
+    code += "#define BITSMITH_BITSLICE_SIMD 1\n";
+    code += "typedef uint64_t bs_w256 __attribute__((vector_size(32)));\n";
+    code += "typedef uint64_t bs_w512 __attribute__((vector_size(64)));\n";
+    code += "#endif\n";
+    code += "#endif\n\n";
+
+    code += "/* " + fn + "*: bit k of block j is bit j % 64 of in[k * W + j / 64], with\n";
+    code += "   W = lanes / 64 words per bit. " + fn + "_auto runs " + fn + "_lanes() blocks. */\n";
+    code += "void " + fn + "(const uint64_t* in, uint64_t* out) {\n";
+    code += bitslicedBody(cx, inpBits, out, gates, "uint64_t", 1);
+    code += "}\n\n";
+
+    code += "#ifdef BITSMITH_BITSLICE_SIMD\n";
+    code += "__attribute__((target(\"avx2\")))\n";
+    code += "void " + fn + "_avx2(const uint64_t* in, uint64_t* out) {\n";
+    code += bitslicedBody(cx, inpBits, out, gates, "bs_w256", 4);
+    code += "}\n\n";
+    code += "__attribute__((target(\"avx512f\")))\n";
+    code += "void " + fn + "_avx512(const uint64_t* in, uint64_t* out) {\n";
+    code += bitslicedBody(cx, inpBits, out, gates, "bs_w512", 8);
+    code += "}\n";
+    code += "#endif\n\n";
+
+    code += "int " + fn + "_lanes(void) {\n";
+    code += "#ifdef BITSMITH_BITSLICE_SIMD\n";
+    code += "    if (__builtin_cpu_supports(\"avx512f\")) return 512;\n";
+    code += "    if (__builtin_cpu_supports(\"avx2\")) return 256;\n";
+    code += "#endif\n";
+    code += "    return 64;\n";
+    code += "}\n\n";
+
+    code += "void " + fn + "_auto(const uint64_t* in, uint64_t* out) {\n";
+    code += "    int lanes = " + fn + "_lanes();\n";
+    code += "#ifdef BITSMITH_BITSLICE_SIMD\n";
+    code += "    if (lanes == 512) { " + fn + "_avx512(in, out); return; }\n";
+    code += "    if (lanes == 256) { " + fn + "_avx2(in, out); return; }\n";
+    code += "#endif\n";
+    code += "    " + fn + "(in, out);\n";
+    code += "}\n";
+
+    return code;
+}
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <thread>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+#include "compiler.hpp"
+#include "preprocessor.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "semantics.hpp"
+#include "optimizer.hpp"
+
+namespace {
+
+// Runs f and adds its wall time in milliseconds to ms, also when f throws, so
+// a failed compile still reports the phase that failed.
+template <class F>
+void timed(double& ms, F&& f) {
+    auto t0 = std::chrono::steady_clock::now();
+    auto stop = [&] { ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count(); };
+    try {
+        f();
+    } catch (...) {
+        stop();
+        throw;
+    }
+    stop();
+}
+
+long peakRssKb() {
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#else
+    return 0;
+#endif
+}
+
+// Gates come after their operands in bitMapping, so one pass in index order
+// gives every node its depth; only the cone of the outputs is counted.
+void graphStats(const CompilationContext& cx, const std::vector<int>& out, CompileStats& stats) {
+    std::vector<bool> live(cx.bitMapping.size(), false);
+    for (int idx : out)
+        if (idx >= 0) live[idx] = true;
+    for (size_t i = cx.bitMapping.size(); i-- > 0;) {
+        const Bit& b = cx.bitMapping[i];
+        if (!live[i] || !isGate(b.op)) continue;
+        ++stats.gatesByOp[static_cast<int>(b.op)];
+        live[b.lhs] = true;
+        if (b.op != Op::Not) live[b.rhs] = true;
+    }
+    std::vector<int> depth(cx.bitMapping.size(), 0);
+    for (size_t i = 0; i < cx.bitMapping.size(); ++i) {
+        const Bit& b = cx.bitMapping[i];
+        if (!live[i] || !isGate(b.op)) continue;
+        depth[i] = 1 + std::max(depth[b.lhs], b.op == Op::Not ? 0 : depth[b.rhs]);
+        stats.maxDepth = std::max(stats.maxDepth, depth[i]);
+    }
+}
+
+CompileResult compile(const CompileJob& job, unsigned analysisThreads) {
+    CompileResult result;
+    CompileStats& stats = result.stats;
+    try {
+        std::string src;
+        timed(stats.preprocessMs, [&] { src = Preprocessor::process(job.source); });
+        Lexer lexer(src);
+        std::vector<Token> tokens;
+        timed(stats.tokenizeMs, [&] { tokens = lexer.tokenize(); });
+        stats.tokens = tokens.size();
+        Parser parser(tokens);
+        Program program;
+        timed(stats.parseMs, [&] { program = parser.parseProgram(); });
+        stats.astNodes = program.arena.nodeCount();
+
+        CompilationContext cx;
+        cx.analysisThreads = analysisThreads;
+        SemanticAnalyzer analyzer(cx);
+        std::vector<int> out;
+        timed(stats.analyzeMs, [&] { out = analyzer.analyze(&program); });
+        stats.foldedBits = cx.gateStats.folded;
+        timed(stats.optimizeMs, [&] { optimizeGraph(cx, out, job.optLevel); });
+        timed(stats.codegenMs, [&] {
+            switch (job.backend) {
+                case Backend::Bit:       result.code = analyzer.cGen(job.name, out); break;
+                case Backend::Word:      result.code = analyzer.cGenWord(job.name, out); break;
+                case Backend::Bitsliced: result.code = analyzer.cGenBitsliced(job.name, out); break;
+            }
+        });
+        result.gates = static_cast<int>(cx.bitMapping.size());
+        stats.codeBytes = result.code.size();
+        graphStats(cx, out, stats);
+    } catch (const std::exception& e) {
+        result.code.clear();
+        result.error = e.what();
+    }
+    stats.peakRssKb = peakRssKb();
+    return result;
+}
+
+} // namespace
+
+CompileResult compileProgram(const CompileJob& job) {
+    return compile(job, job.analysisThreads);
+}
+
+std::string statsJson(const CompileStats& stats) {
+    auto ms = [](double v) { return std::to_string(v); };
+    std::string json = "{";
+    json += "\"phases_ms\": {";
+    json += "\"preprocess\": " + ms(stats.preprocessMs);
+    json += ", \"tokenize\": " + ms(stats.tokenizeMs);
+    json += ", \"parse\": " + ms(stats.parseMs);
+    json += ", \"analyze\": " + ms(stats.analyzeMs);
+    json += ", \"optimize\": " + ms(stats.optimizeMs);
+    json += ", \"codegen\": " + ms(stats.codegenMs);
+    json += "}, \"peak_rss_kb\": " + std::to_string(stats.peakRssKb);
+    json += ", \"tokens\": " + std::to_string(stats.tokens);
+    json += ", \"ast_nodes\": " + std::to_string(stats.astNodes);
+    json += ", \"gates\": {";
+    const Op ops[] = {Op::And, Op::Or, Op::Xor, Op::Not};
+    const char* names[] = {"and", "or", "xor", "not"};
+    for (int k = 0; k < 4; ++k) {
+        if (k) json += ", ";
+        json += "\"" + std::string(names[k]) + "\": " + std::to_string(stats.gatesByOp[static_cast<int>(ops[k])]);
+    }
+    json += "}, \"max_depth\": " + std::to_string(stats.maxDepth);
+    json += ", \"folded_bits\": " + std::to_string(stats.foldedBits);
+    json += ", \"code_bytes\": " + std::to_string(stats.codeBytes);
+    json += "}";
+    return json;
+}
+
+// Workers take the next unclaimed job until none are left, so one slow
+// program does not hold up a whole share of the batch. With more than one
+// worker the batch already fills the cores, so each job analyzes on its own
+// thread only; a batch run on one thread keeps the jobs' analysisThreads.
+std::vector<CompileResult> compileBatch(const std::vector<CompileJob>& jobs, unsigned threads) {
+    std::vector<CompileResult> results(jobs.size());
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::min<size_t>(threads, jobs.size()));
+
+    std::atomic<size_t> next{0};
+    auto work = [&]() {
+        for (size_t k; (k = next.fetch_add(1)) < jobs.size();) results[k] = compile(jobs[k], threads > 1 ? 1 : jobs[k].analysisThreads);
+    };
+    if (threads <= 1) {
+        work();
+        return results;
+    }
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; ++t) pool.emplace_back(work);
+    for (std::thread& t : pool) t.join();
+    return results;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <string>
+#include <vector>
+
+enum class Backend { Bit, Word, Bitsliced };
+
+// One program to compile: its source before preprocessing, the name of the
+// generated C function, the optimizeGraph level and the code generator.
+// analysisThreads is passed on to the CompilationContext; it stays 1 unless
+// the caller has cores to spare, and 0 means one per hardware thread.
+struct CompileJob {
+    std::string source;
+    std::string name = "bitsmith";
+    int optLevel = 0;
+    Backend backend = Backend::Bit;
+    unsigned analysisThreads = 1;
+};
+
+// What one compilation cost and built. Phase times are wall-clock
+// milliseconds. gatesByOp counts the And, Or, Xor and Not gates the outputs
+// depend on after optimization, indexed by Op, and maxDepth is the longest
+// chain of them from an input or constant to an output. peakRssKb is the
+// whole process's high-water mark so far, 0 where getrusage is missing.
+struct CompileStats {
+    double preprocessMs = 0, tokenizeMs = 0, parseMs = 0, analyzeMs = 0, optimizeMs = 0, codegenMs = 0;
+    long peakRssKb = 0;
+    size_t tokens = 0;
+    size_t astNodes = 0;
+    long long gatesByOp[8] = {};
+    int maxDepth = 0;
+    long long foldedBits = 0;   // gate requests the analyzer folded away
+    size_t codeBytes = 0;
+};
+
+// The generated C, or the message of the exception that stopped the
+// compilation, in which case code is empty.
+struct CompileResult {
+    std::string code;
+    std::string error;
+    int gates = 0;   // nodes left in bitMapping
+    CompileStats stats;   // filled in up to the phase that failed
+    bool ok() const { return error.empty(); }
+};
+
+// Runs every phase for one job in a CompilationContext of its own. Never
+// throws for a bad program; the error lands in the result.
+CompileResult compileProgram(const CompileJob& job);
+
+// The stats as one JSON object, for callers that log or export them.
+std::string statsJson(const CompileStats& stats);
+
+// Compiles jobs on up to threads workers (0 for one per hardware thread) and
+// returns their results in the same order. Each job gets its own context, so
+// the results do not depend on the thread count.
+std::vector<CompileResult> compileBatch(const std::vector<CompileJob>& jobs, unsigned threads = 0);
@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "evaluator.hpp"
+
+namespace {
+
+// Transposes an 8x8 bit matrix held one row per byte: bit c of byte r moves
+// to bit r of byte c.
+uint64_t transpose8(uint64_t x) {
+    uint64_t t;
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+    x = x ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+    x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+    x = x ^ t ^ (t << 28);
+    return x;
+}
+
+} // namespace
+
+Evaluator::Evaluator(const CompilationContext& cx, int argc, const std::vector<int>& out) : argc(argc) {
+    int n = static_cast<int>(cx.bitMapping.size());
+    std::vector<bool> live(n, false);
+    std::vector<int> stack(out.begin(), out.end());
+    while (!stack.empty()) {
+        int idx = stack.back();
+        stack.pop_back();
+        if (idx < 0 || idx >= n) throw std::runtime_error("Evaluator: output bit out of range");
+        if (live[idx]) continue;
+        live[idx] = true;
+        if (isGate(cx.bitMapping[idx].op)) {
+            stack.push_back(cx.bitMapping[idx].lhs);
+            if (cx.bitMapping[idx].op != Op::Not) stack.push_back(cx.bitMapping[idx].rhs);
+        }
+    }
+
+    // Non-gate nodes past the inputs are unassigned placeholders and read as 0.
+    std::vector<int> value(n, 0);
+    for (int i = 1; i < std::min(n, argc + 2); ++i) value[i] = i;
+    for (int i = argc + 2; i < n; ++i) {
+        if (!live[i] || !isGate(cx.bitMapping[i].op)) continue;
+        const Bit& b = cx.bitMapping[i];
+        value[i] = argc + 2 + static_cast<int>(steps.size());
+        steps.push_back({b.op, value[b.lhs], b.op == Op::Not ? 0 : value[b.rhs]});
+    }
+    for (int idx : out) outputs.push_back(value[idx]);
+}
+
+void Evaluator::evaluate(std::vector<uint64_t>& values) const {
+    uint64_t* v = values.data();
+    uint64_t* dst = v + argc + 2;
+    for (const Step& s : steps) {
+        switch (s.op) {
+            case Op::And: *dst = v[s.lhs] & v[s.rhs]; break;
+            case Op::Or:  *dst = v[s.lhs] | v[s.rhs]; break;
+            case Op::Xor: *dst = v[s.lhs] ^ v[s.rhs]; break;
+            case Op::Not: *dst = ~v[s.lhs]; break;
+            default: throw std::runtime_error("Evaluator: unexpected node");
+        }
+        ++dst;
+    }
+}
+
+void Evaluator::run(const uint8_t* in, uint8_t* out, size_t count) const {
+    const int inBytes = inputBytes();
+    const int outBytes = outputBytes();
+    std::vector<uint64_t> values(argc + 2 + steps.size(), 0);
+    values[1] = ~0ULL;
+    std::vector<uint8_t> inBlock(64 * static_cast<size_t>(inBytes));
+    std::vector<uint8_t> outBlock(64 * static_cast<size_t>(outBytes));
+
+    for (size_t base = 0; base < count; base += 64) {
+        size_t lanes = std::min<size_t>(64, count - base);
+        const uint8_t* src = in + base * inBytes;
+        if (lanes < 64) {
+            std::fill(inBlock.begin(), inBlock.end(), 0);
+            std::memcpy(inBlock.data(), src, lanes * inBytes);
+            src = inBlock.data();
+        }
+
+        // Byte b of eight consecutive records forms an 8x8 matrix whose
+        // transpose holds one input bit of all eight records per byte.
+        for (int b = 0; b < inBytes; ++b) {
+            for (int g = 0; g < 8; ++g) {
+                uint64_t x = 0;
+                for (int r = 0; r < 8; ++r)
+                    x |= static_cast<uint64_t>(src[(8 * g + r) * inBytes + b]) << (8 * r);
+                x = transpose8(x);
+                for (int c = 0; c < 8; ++c) {
+                    int k = 8 * b + 7 - c;
+                    if (k >= argc) continue;
+                    uint64_t& lane = values[2 + k];
+                    if (g == 0) lane = 0;
+                    lane |= ((x >> (8 * c)) & 0xFF) << (8 * g);
+                }
+            }
+        }
+
+        evaluate(values);
+
+        uint8_t* dst = lanes < 64 ? outBlock.data() : out + base * outBytes;
+        for (int b = 0; b < outBytes; ++b) {
+            for (int g = 0; g < 8; ++g) {
+                uint64_t x = 0;
+                for (int c = 0; c < 8; ++c) {
+                    size_t i = 8 * b + 7 - c;
+                    if (i < outputs.size())
+                        x |= ((values[outputs[i]] >> (8 * g)) & 0xFF) << (8 * c);
+                }
+                x = transpose8(x);
+                for (int r = 0; r < 8; ++r)
+                    dst[(8 * g + r) * outBytes + b] = static_cast<uint8_t>(x >> (8 * r));
+            }
+        }
+        if (lanes < 64) std::memcpy(out + base * outBytes, outBlock.data(), lanes * outBytes);
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "semantics.hpp"
+
+// Runs the gate graph in a context's bitMapping without generating any code.
+// Every node holds a uint64_t whose bit j is the node's value for record j, so
+// each pass over the gates evaluates 64 records. The gates the outputs depend
+// on are copied out at construction, so later analyze() calls do not affect
+// it.
+class Evaluator {
+public:
+    Evaluator(const CompilationContext& cx, int argc, const std::vector<int>& out);
+
+    // Records are packed back to back: record r reads inputBytes() bytes at
+    // in + r * inputBytes() and writes outputBytes() bytes at out + r * outputBytes(),
+    // with the same MSB-first bit layout as cGen.
+    void run(const uint8_t* in, uint8_t* out, size_t count) const;
+
+    int inputBytes() const { return (argc + 7) / 8; }
+    int outputBytes() const { return (static_cast<int>(outputs.size()) + 7) / 8; }
+
+private:
+    struct Step { Op op; int lhs; int rhs; };
+
+    int argc;
+    std::vector<Step> steps;      // gate k writes value argc + 2 + k
+    std::vector<int> outputs;     // value index of each output bit
+
+    void evaluate(std::vector<uint64_t>& values) const;
+};
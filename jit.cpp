@@ -0,0 +1,368 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "jit.hpp"
+#include "semantics.hpp"
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define BITSMITH_JIT 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Every bit lives in a 32-bit register as 0 or 1. Registers are allocated
+// greedily along the gate schedule: an operand whose last use is the current
+// gate donates its register to the result, and when all thirteen registers
+// are taken the value used furthest in the future is evicted. Inputs and
+// constants are never spilled since they are cheaper to reload than to store;
+// gate results get a 4-byte stack slot the first time they are evicted, and
+// the slot is reused once their last reader has run. The System V ABI passes
+// in in RDI and out in RSI; RBX, RBP and R12-R15 are saved around the body.
+
+namespace {
+
+enum Reg : int { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RDI = 7,
+                 R8 = 8, R9, R10, R11, R12, R13, R14, R15 };
+const int allocatable[] = {RDX, R8, R9, R10, R11, RBX, RBP, R12, R13, R14, R15, RAX, RCX};
+const int calleeSaved[] = {RBX, RBP, R12, R13, R14, R15};
+const int noPin = -1;
+
+class Emitter {
+public:
+    std::vector<uint8_t> bytes;
+
+    void raw(std::initializer_list<uint8_t> b) { bytes.insert(bytes.end(), b); }
+    void imm8(int v) { bytes.push_back(static_cast<uint8_t>(v)); }
+    void imm32(int32_t v) {
+        for (int i = 0; i < 4; ++i) bytes.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    }
+    void rex(bool r, bool b) {
+        if (r || b) imm8(0x40 | (r ? 4 : 0) | (b ? 1 : 0));
+    }
+
+    // op dst, src on 32-bit registers; opcode is the "r/m, reg" form.
+    void rr(uint8_t opcode, int dst, int src) {
+        rex(src >= 8, dst >= 8);
+        raw({opcode, static_cast<uint8_t>(0xC0 | (src & 7) << 3 | (dst & 7))});
+    }
+    // op reg, [base + disp32]; base is RSP or RDI.
+    void rm(std::initializer_list<uint8_t> opcode, int reg, int base, int32_t disp) {
+        rex(reg >= 8, false);
+        raw(opcode);
+        imm8(0x80 | (reg & 7) << 3 | base);
+        if (base == RSP) imm8(0x24);
+        imm32(disp);
+    }
+    // Group opcodes with an immediate byte: C1 /4 shl, C1 /5 shr, 83 /4 and, 83 /6 xor.
+    void ri8(uint8_t opcode, int ext, int r, int v) {
+        rex(false, r >= 8);
+        raw({opcode, static_cast<uint8_t>(0xC0 | ext << 3 | (r & 7))});
+        imm8(v);
+    }
+
+    void movImm(int r, int v) {
+        if (v == 0) { rr(0x31, r, r); return; }
+        rex(false, r >= 8);
+        imm8(0xB8 | (r & 7));
+        imm32(v);
+    }
+    void loadInputBit(int r, int k) {
+        rm({0x0F, 0xB6}, r, RDI, k / 8);
+        if (7 - k % 8) ri8(0xC1, 5, r, 7 - k % 8);
+        ri8(0x83, 4, r, 1);
+    }
+    void push(int r) { rex(false, r >= 8); imm8(0x50 | (r & 7)); }
+    void pop(int r)  { rex(false, r >= 8); imm8(0x58 | (r & 7)); }
+    void subRsp(int32_t n) { raw({0x48, 0x81, 0xEC}); imm32(n); }
+    void addRsp(int32_t n) { raw({0x48, 0x81, 0xC4}); imm32(n); }
+    void probeRsp()        { raw({0x80, 0x0C, 0x24, 0x00}); }        // or byte [rsp], 0
+    void orEcxImm(int32_t v) { raw({0x81, 0xC9}); imm32(v); }
+    void storeCl(int32_t byte) { raw({0x88, 0x8E}); imm32(byte); }   // mov [rsi + d], cl
+    void ret()             { imm8(0xC3); }
+};
+
+uint8_t rrOpcode(Op op) {
+    switch (op) {
+        case Op::And: return 0x21;
+        case Op::Or:  return 0x09;
+        case Op::Xor: return 0x31;
+        default: throw std::runtime_error("JIT: not a binary gate");
+    }
+}
+
+class Allocator {
+public:
+    const CompilationContext& cx;
+    int argc;
+    Emitter& e;
+    std::vector<int> reg;
+    std::vector<int32_t> slot;
+    std::vector<std::vector<int>> uses;
+    std::vector<size_t> cursor;
+    std::vector<int32_t> freeSlots;
+    int owner[16];
+    int32_t frame = 0;
+
+    Allocator(const CompilationContext& cx, int argc, Emitter& e)
+        : cx(cx), argc(argc), e(e), reg(cx.bitMapping.size(), -1), slot(cx.bitMapping.size(), -1),
+          uses(cx.bitMapping.size()), cursor(cx.bitMapping.size(), 0) {
+        std::fill(std::begin(owner), std::end(owner), -1);
+    }
+
+    bool rematerializable(int idx) const { return !isGate(cx.bitMapping[idx].op); }
+
+    int nextUse(int idx) const {
+        return cursor[idx] < uses[idx].size() ? uses[idx][cursor[idx]] : INT_MAX;
+    }
+
+    void consume(int idx, int pos) {
+        while (cursor[idx] < uses[idx].size() && uses[idx][cursor[idx]] <= pos) ++cursor[idx];
+    }
+
+    void materialize(int r, int idx) {
+        if (idx >= 2 && idx < argc + 2) e.loadInputBit(r, idx - 2);
+        else e.movImm(r, cx.bitMapping[idx].op == Op::Const1 ? 1 : 0);
+    }
+
+    void evict(int r) {
+        int idx = owner[r];
+        if (idx < 0) return;
+        if (!rematerializable(idx) && slot[idx] < 0 && nextUse(idx) != INT_MAX) {
+            if (freeSlots.empty()) {
+                slot[idx] = frame;
+                frame += 4;
+            } else {
+                slot[idx] = freeSlots.back();
+                freeSlots.pop_back();
+            }
+            e.rm({0x89}, r, RSP, slot[idx]);
+        }
+        reg[idx] = -1;
+        owner[r] = -1;
+    }
+
+    // Hands a value's stack slot back once nothing reads it any more, so the
+    // frame grows with the values spilled at once rather than in total.
+    void retire(int idx) {
+        if (slot[idx] < 0 || nextUse(idx) != INT_MAX) return;
+        freeSlots.push_back(slot[idx]);
+        slot[idx] = -1;
+    }
+
+    void release(int r) {
+        if (owner[r] >= 0) reg[owner[r]] = -1;
+        owner[r] = -1;
+    }
+
+    int alloc(int pinA, int pinB) {
+        int victim = -1;
+        long furthest = -1;
+        for (int r : allocatable) {
+            if (r == pinA || r == pinB) continue;
+            if (owner[r] < 0) return r;
+            // Ties go to values that can be reloaded without a spill.
+            long next = 2L * nextUse(owner[r]) + (rematerializable(owner[r]) ? 1 : 0);
+            if (next > furthest) { furthest = next; victim = r; }
+        }
+        evict(victim);
+        return victim;
+    }
+
+    int bind(int r, int idx) {
+        owner[r] = idx;
+        reg[idx] = r;
+        return r;
+    }
+
+    int ensure(int idx, int pin) {
+        if (reg[idx] >= 0) return reg[idx];
+        int r = alloc(pin, noPin);
+        if (slot[idx] >= 0) e.rm({0x8B}, r, RSP, slot[idx]);
+        else materialize(r, idx);
+        return bind(r, idx);
+    }
+
+    void gate(int idx, int pos) {
+        const Bit& g = cx.bitMapping[idx];
+        int ra = ensure(g.lhs, noPin);
+        if (g.op == Op::Not) {
+            consume(g.lhs, pos);
+            int dst = ra;
+            if (nextUse(g.lhs) != INT_MAX) {
+                dst = alloc(ra, noPin);
+                e.rr(0x89, dst, ra);
+            } else {
+                release(ra);
+            }
+            e.ri8(0x83, 6, dst, 1);
+            retire(g.lhs);
+            bind(dst, idx);
+            return;
+        }
+
+        uint8_t opcode = rrOpcode(g.op);
+        bool rhsInMemory = reg[g.rhs] < 0 && slot[g.rhs] >= 0;
+        int rb = rhsInMemory ? -1 : ensure(g.rhs, ra);
+        consume(g.lhs, pos);
+        consume(g.rhs, pos);
+        bool lhsDies = nextUse(g.lhs) == INT_MAX;
+        bool rhsDies = nextUse(g.rhs) == INT_MAX;
+
+        int dst;
+        if (lhsDies) {
+            dst = ra;
+        } else if (rhsDies && rb >= 0) {
+            dst = rb;
+            rb = ra;
+        } else {
+            dst = alloc(ra, rb);
+            e.rr(0x89, dst, ra);
+        }
+        if (rb >= 0) e.rr(opcode, dst, rb);
+        else e.rm({static_cast<uint8_t>(opcode + 2)}, dst, RSP, slot[g.rhs]);
+
+        if (lhsDies && reg[g.lhs] >= 0) release(reg[g.lhs]);
+        if (rhsDies && reg[g.rhs] >= 0) release(reg[g.rhs]);
+        retire(g.lhs);
+        retire(g.rhs);
+        release(dst);
+        bind(dst, idx);
+    }
+};
+
+} // namespace
+
+JitProgram::JitProgram(const CompilationContext& cx, int argc, const std::vector<int>& out) {
+#ifndef BITSMITH_JIT
+    (void)cx;
+    (void)argc;
+    (void)out;
+    throw std::runtime_error("JIT is only available on x86-64 POSIX hosts");
+#else
+    auto gateOf = [&](int idx) -> const Bit* {
+        if (idx < argc + 2 || idx >= static_cast<int>(cx.bitMapping.size())) return nullptr;
+        return isGate(cx.bitMapping[idx].op) ? &cx.bitMapping[idx] : nullptr;
+    };
+
+    // Gates are scheduled in depth-first post-order from the outputs, which
+    // finishes one output cone before starting the next and keeps far fewer
+    // values live than index order does on wide, shallow layers.
+    std::vector<int> order;
+    std::vector<bool> seen(cx.bitMapping.size(), false);
+    std::vector<std::pair<int, bool>> stack;
+    for (auto it = out.rbegin(); it != out.rend(); ++it) stack.push_back({*it, false});
+    while (!stack.empty()) {
+        auto [idx, expanded] = stack.back();
+        stack.pop_back();
+        const Bit* g = gateOf(idx);
+        if (!g) continue;
+        if (expanded) {
+            order.push_back(idx);
+            continue;
+        }
+        if (seen[idx]) continue;
+        seen[idx] = true;
+        stack.push_back({idx, true});
+        if (g->op != Op::Not) stack.push_back({g->rhs, false});
+        stack.push_back({g->lhs, false});
+    }
+
+    Emitter body;
+    Allocator regs(cx, argc, body);
+    for (size_t p = 0; p < order.size(); ++p) {
+        const Bit& g = cx.bitMapping[order[p]];
+        regs.uses[g.lhs].push_back(static_cast<int>(p));
+        if (g.op != Op::Not) regs.uses[g.rhs].push_back(static_cast<int>(p));
+    }
+    for (int idx : out) regs.uses[idx].push_back(static_cast<int>(order.size()));
+
+    for (size_t p = 0; p < order.size(); ++p) regs.gate(order[p], static_cast<int>(p));
+
+    // Output bytes are assembled in ECX with EAX as scratch.
+    regs.evict(RAX);
+    regs.evict(RCX);
+    int outBytes = (static_cast<int>(out.size()) + 7) / 8;
+    for (int byte = 0; byte < outBytes; ++byte) {
+        body.rr(0x31, RCX, RCX);
+        int ones = 0;
+        for (int i = byte * 8; i < byte * 8 + 8 && i < static_cast<int>(out.size()); ++i) {
+            int idx = out[i];
+            int shift = 7 - i % 8;
+            Op op = cx.bitMapping[idx].op;
+            if (op == Op::Const1) ones |= 1 << shift;
+            if (op == Op::Const0 || op == Op::Const1 || op == Op::Undef) continue;
+            if (regs.reg[idx] >= 0) body.rr(0x89, RAX, regs.reg[idx]);
+            else if (regs.slot[idx] >= 0) body.rm({0x8B}, RAX, RSP, regs.slot[idx]);
+            else regs.materialize(RAX, idx);
+            if (shift) body.ri8(0xC1, 4, RAX, shift);
+            body.rr(0x09, RCX, RAX);
+        }
+        if (ones) body.orEcxImm(ones);
+        body.storeCl(byte);
+    }
+
+    // Frames beyond a page are touched one page at a time so the guard page
+    // below the stack is never skipped.
+    int32_t frame = (regs.frame + 15) & ~15;
+    Emitter e;
+    for (int r : calleeSaved) e.push(r);
+    for (int32_t done = 0; done < frame;) {
+        int32_t step = std::min<int32_t>(4096, frame - done);
+        e.subRsp(step);
+        e.probeRsp();
+        done += step;
+    }
+    e.bytes.insert(e.bytes.end(), body.bytes.begin(), body.bytes.end());
+    if (frame) e.addRsp(frame);
+    for (int i = 5; i >= 0; --i) e.pop(calleeSaved[i]);
+    e.ret();
+
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size = e.bytes.size();
+    mapped = (size + page - 1) / page * page;
+    void* mem = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) throw std::runtime_error("JIT: mmap failed");
+    std::memcpy(mem, e.bytes.data(), size);
+    if (mprotect(mem, mapped, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, mapped);
+        throw std::runtime_error("JIT: mprotect failed");
+    }
+    code = mem;
+    entry = reinterpret_cast<Fn>(mem);
+#endif
+}
+
+JitProgram::~JitProgram() { release(); }
+
+JitProgram::JitProgram(JitProgram&& other) noexcept
+    : code(other.code), size(other.size), mapped(other.mapped), entry(other.entry) {
+    other.code = nullptr;
+    other.entry = nullptr;
+    other.size = other.mapped = 0;
+}
+
+JitProgram& JitProgram::operator=(JitProgram&& other) noexcept {
+    if (this != &other) {
+        release();
+        code = other.code;
+        size = other.size;
+        mapped = other.mapped;
+        entry = other.entry;
+        other.code = nullptr;
+        other.entry = nullptr;
+        other.size = other.mapped = 0;
+    }
+    return *this;
+}
+
+void JitProgram::release() {
+#ifdef BITSMITH_JIT
+    if (code) munmap(code, mapped);
+#endif
+    code = nullptr;
+    entry = nullptr;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct CompilationContext;
+
+// Native x86-64 code for the gate graph in a context's bitMapping, built
+// straight into an executable mapping. The generated function has cGen's
+// semantics with a caller-owned output buffer: input bit k is bit 7 - k % 8
+// of in[k / 8] and output bit i is written to bit 7 - i % 8 of out[i / 8].
+class JitProgram {
+public:
+    using Fn = void (*)(const uint8_t* in, uint8_t* out);
+
+    JitProgram(const CompilationContext& cx, int argc, const std::vector<int>& out);
+    ~JitProgram();
+    JitProgram(JitProgram&& other) noexcept;
+    JitProgram& operator=(JitProgram&& other) noexcept;
+    JitProgram(const JitProgram&) = delete;
+    JitProgram& operator=(const JitProgram&) = delete;
+
+    Fn fn() const { return entry; }
+    size_t codeSize() const { return size; }
+    void operator()(const uint8_t* in, uint8_t* out) const { entry(in, out); }
+
+private:
+    void* code = nullptr;
+    size_t size = 0;
+    size_t mapped = 0;
+    Fn entry = nullptr;
+
+    void release();
+};
@@ -2,7 +2,7 @@
 #include <stdexcept>
 #include "lexer.hpp"
 
-Lexer::Lexer(const std::string &src) : source(src) {}
+Lexer::Lexer(std::string_view src) : source(src) {}
 
 bool Lexer::eof() const { return pos >= source.size(); }
 
@@ -22,8 +22,8 @@ char Lexer::get() {
     return c;
 }
 
-Token Lexer::makeToken(TokenType t, const std::string &v, int tl, int tc) const {
-    return Token{t, v, tl, tc};
+Token Lexer::makeToken(TokenType t, size_t start, int tl, int tc) const {
+    return Token{t, source.substr(start, pos - start), tl, tc, Literal{}};
 }
 
 void Lexer::skipWhitespace() {
@@ -37,122 +37,119 @@ void Lexer::skipWhitespace() {
     }
 }
 
+Literal Lexer::literal(int base, std::string_view digits) const {
+    Literal lit;
+    lit.base = static_cast<uint8_t>(base);
+    for (char d : digits) {
+        uint64_t v = std::isdigit(static_cast<unsigned char>(d))
+            ? d - '0'
+            : std::tolower(static_cast<unsigned char>(d)) - 'a' + 10;
+        if (lit.number > (UINT64_MAX - v) / base) lit.fits = false;
+        lit.number = lit.number * base + v;
+    }
+    return lit;
+}
+
+TokenType Lexer::keyword(std::string_view word) {
+    switch (word.size()) {
+        case 5:
+            if (word == "table") return TokenType::TABLE;
+            if (word == "field") return TokenType::FIELD;
+            break;
+        case 6:
+            if (word == "return") return TokenType::RETURN;
+            if (word == "repeat") return TokenType::REPEAT;
+            break;
+        case 8:
+            if (word == "function") return TokenType::FUNCTION;
+            break;
+    }
+    return TokenType::IDENTIFIER;
+}
+
 std::vector<Token> Lexer::tokenize() {
     std::vector<Token> out;
+    // Tokens average well over two source characters each, so this covers real
+    // programs without a regrow; pages that are never written cost nothing.
+    out.reserve(source.size() / 2 + 1);
     while (true) {
         skipWhitespace();
         if (eof()) break;
         int tl = line, tc = col;
+        size_t start = pos;
         char c = get();
 
         if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
-            std::string id(1, c);
-            while (!eof() && (std::isalnum(peek()) || peek() == '_')) id.push_back(get());
-            auto kwIt = keywords.find(id);
-            if (kwIt != keywords.end())
-                out.push_back(makeToken(kwIt->second, id, tl, tc));
-            else
-                out.push_back(makeToken(TokenType::IDENTIFIER, id, tl, tc));
+            while (!eof() && (std::isalnum(static_cast<unsigned char>(peek())) || peek() == '_')) get();
+            out.push_back(makeToken(keyword(source.substr(start, pos - start)), start, tl, tc));
             continue;
         }
 
         if (std::isdigit(static_cast<unsigned char>(c))) {
-            std::string num(1, c);
+            Literal lit;
             if (c == '0' && (peek() == 'x' || peek() == 'X')) {
                 get();
-                num = "hex(";
-                while (!eof() && std::isxdigit(peek())) {
-                    num.push_back(get());
-                }
-                num += ')';
+                size_t digits = pos;
+                while (!eof() && std::isxdigit(static_cast<unsigned char>(peek()))) get();
+                lit = literal(16, source.substr(digits, pos - digits));
             } else {
-                while (!eof() && std::isdigit(peek())) num.push_back(get());
-                num = "bit(" + num + ")";
+                while (!eof() && std::isdigit(static_cast<unsigned char>(peek()))) get();
+                lit = literal(10, source.substr(start, pos - start));
             }
-
-            out.push_back(makeToken(TokenType::DATA, num, tl, tc));
+            Token tok = makeToken(TokenType::DATA, start, tl, tc);
+            tok.literal = lit;
+            out.push_back(tok);
             continue;
         }
 
-        std::string four;
-        for (int i = 0; i < 4 && pos + i - 1 < source.size(); ++i) four.push_back(i == 0 ? c : source[pos + i - 1]);
-        if (four.size() >= 3) {
-            std::string three = four.substr(0, 3);
-            auto it3 = twoCharOps.find(three);
-            if (it3 != twoCharOps.end()) {
-                get();
+        TokenType type;
+        switch (c) {
+            case '<':
+            case '>':
+                if (peek() != c) throw std::runtime_error("Unexpected character '" + std::string(1, c) + "'");
                 get();
-                out.push_back(makeToken(it3->second, three, tl, tc));
-                continue;
-            }
-        }
-        if (four.size() >= 4) {
-            std::string fourStr = four.substr(0, 4);
-            auto it4 = twoCharOps.find(fourStr);
-            if (it4 != twoCharOps.end()) {
-                get();
-                get();
-                get();
-                out.push_back(makeToken(it4->second, fourStr, tl, tc));
-                continue;
-            }
-        }
-
-        std::string two(1, c);
-        two.push_back(peek());
-        auto twoIt = twoCharOps.find(two);
-        if (twoIt != twoCharOps.end()) {
-            get();
-            out.push_back(makeToken(twoIt->second, two, tl, tc));
-            continue;
-        }
-
-        auto oneOp = singleCharOps.find(c);
-        if (oneOp != singleCharOps.end()) {
-            out.push_back(makeToken(oneOp->second, std::string(1, c), tl, tc));
-            continue;
-        }
-
-        auto punct = punctuation.find(c);
-        if (punct != punctuation.end()) {
-            out.push_back(makeToken(punct->second, std::string(1, c), tl, tc));
-            continue;
+                if (peek() == c) {
+                    get();
+                    type = c == '<' ? TokenType::CSL : TokenType::CSR;
+                } else {
+                    type = c == '<' ? TokenType::SL : TokenType::SR;
+                }
+                break;
+            case ':':
+                if (peek() == ':') {
+                    get();
+                    type = TokenType::CONCAT;
+                } else {
+                    type = TokenType::COLON;
+                }
+                break;
+            case '=': type = TokenType::EQ; break;
+            case '|': type = TokenType::PIPE; break;
+            case '&': type = TokenType::AMP; break;
+            case '^': type = TokenType::XOR; break;
+            case '~': type = TokenType::TILDE; break;
+            case '+': type = TokenType::PLUS; break;
+            case '-':
+                if (peek() == '>') {
+                    get();
+                    type = TokenType::ARROW;
+                } else {
+                    type = TokenType::MINUS;
+                }
+                break;
+            case ',': type = TokenType::COMMA; break;
+            case ';': type = TokenType::SEMICOLON; break;
+            case '{': type = TokenType::OPEN_BRACE; break;
+            case '}': type = TokenType::CLOSE_BRACE; break;
+            case '(': type = TokenType::OPEN_PAREN; break;
+            case ')': type = TokenType::CLOSE_PAREN; break;
+            case '[': type = TokenType::OPEN_SQR; break;
+            case ']': type = TokenType::CLOSE_SQR; break;
+            default:
+                throw std::runtime_error("Unexpected character '" + std::string(1, c) + "'");
         }
-
-        throw std::runtime_error("Unexpected character '" + std::string(1, c) + "'");
+        out.push_back(makeToken(type, start, tl, tc));
     }
-    out.push_back(makeToken(TokenType::END_OF_FILE, "", line, col));
+    out.push_back(makeToken(TokenType::END_OF_FILE, pos, line, col));
     return out;
 }
-
-const std::unordered_map<std::string, TokenType> Lexer::keywords = {
-    {"function", TokenType::FUNCTION},
-    {"return", TokenType::RETURN}
-};
-
-const std::unordered_map<std::string, TokenType> Lexer::twoCharOps = {
-    {"<<", TokenType::SL},
-    {">>", TokenType::SR},
-    {"<<<", TokenType::CSL},
-    {">>>", TokenType::CSR},
-    {"::", TokenType::CONCAT}
-};
-
-const std::unordered_map<char, TokenType> Lexer::singleCharOps = {
-    {'=', TokenType::EQ},
-    {'|', TokenType::PIPE},
-    {'&', TokenType::AMP},
-    {'^', TokenType::XOR},
-    {'~', TokenType::TILDE}
-};
-
-const std::unordered_map<char, TokenType> Lexer::punctuation = {
-    {':', TokenType::COLON},
-    {';', TokenType::SEMICOLON},
-    {'{', TokenType::OPEN_BRACE},
-    {'}', TokenType::CLOSE_BRACE},
-    {'(', TokenType::OPEN_PAREN},
-    {')', TokenType::CLOSE_PAREN},
-    {'[', TokenType::OPEN_SQR},
-    {']', TokenType::CLOSE_SQR}
-};
@@ -1,35 +1,51 @@
 #pragma once
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <unordered_map>
 
-enum class TokenType {
-    FUNCTION, RETURN,
+enum class TokenType : uint8_t {
+    FUNCTION, TABLE, FIELD, RETURN, REPEAT,
     IDENTIFIER,
     DATA,
-    COLON, SEMICOLON,
+    COLON, SEMICOLON, COMMA, ARROW,
     OPEN_BRACE, CLOSE_BRACE,
     OPEN_PAREN, CLOSE_PAREN,
     OPEN_SQR, CLOSE_SQR,
     EQ,
     PIPE, AMP, XOR, TILDE,
+    PLUS, MINUS,
     SL, SR, CSL, CSR, CONCAT,
     END_OF_FILE
 };
 
+// Payload of a DATA token, decoded once by the lexer: the radix it was
+// written in and its value when that fits in 64 bits.
+struct Literal {
+    uint64_t number = 0;
+    uint8_t base = 10;
+    bool fits = true;
+};
+
+// Token text points into the buffer given to the Lexer, which must outlive
+// the tokens.
 struct Token {
     TokenType type;
-    std::string value;
+    std::string_view value;
     int line{1}, col{1};
+    Literal literal;
+
+    // Digits of a DATA token without any 0x prefix.
+    std::string_view digits() const { return literal.base == 16 ? value.substr(2) : value; }
 };
 
 class Lexer {
 public:
-    explicit Lexer(const std::string &src);
+    explicit Lexer(std::string_view src);
     std::vector<Token> tokenize();
 
 private:
-    std::string source;
+    std::string_view source;
     size_t pos{0};
     int line{1}, col{1};
 
@@ -38,10 +54,8 @@ private:
     char peekN(size_t n) const;
     char get();
     void skipWhitespace();
-    Token makeToken(TokenType t, const std::string &v, int tl, int tc) const;
+    Token makeToken(TokenType t, size_t start, int tl, int tc) const;
+    Literal literal(int base, std::string_view digits) const;
 
-    static const std::unordered_map<std::string, TokenType> keywords;
-    static const std::unordered_map<std::string, TokenType> twoCharOps;
-    static const std::unordered_map<char, TokenType> singleCharOps;
-    static const std::unordered_map<char, TokenType> punctuation;
+    static TokenType keyword(std::string_view word);
 };
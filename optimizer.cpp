@@ -0,0 +1,650 @@
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <queue>
+#include <unordered_map>
+#include "optimizer.hpp"
+#include "aig.hpp"
+#include "semantics.hpp"
+
+static GateKey keyOf(Op op, int lhs, int rhs) {
+    bool commutative = op != Op::Not;
+    return GateKey{op,
+                   commutative ? std::min(lhs, rhs) : lhs,
+                   commutative ? std::max(lhs, rhs) : rhs};
+}
+
+namespace {
+
+// The parts of a LoopRegion that name nodes of the graph being rewritten.
+struct LoopSpan {
+    int firstNode;
+    int endNode;
+    std::vector<int> entry;
+    std::vector<int> exit;
+};
+
+// Liveness and fanout seen from the outputs. A loop's entry bits count as
+// read while any exit bit built inside the loop is live, since codegen
+// starts the rolled loop from them.
+struct Usage {
+    std::vector<char> live;
+    std::vector<int> fanout;
+    int gates = 0;
+};
+
+Usage usage(const std::vector<Bit>& g, const std::vector<int>& out, const std::vector<LoopSpan>& loops) {
+    int n = static_cast<int>(g.size());
+    Usage u;
+    u.live.assign(n, 0);
+    u.fanout.assign(n, 0);
+    auto use = [&](int i) {
+        u.live[i] = 1;
+        ++u.fanout[i];
+    };
+    for (int o : out) use(o);
+
+    size_t loop = loops.size();
+    for (int i = n - 1; i >= 0; --i) {
+        for (; loop > 0 && loops[loop - 1].firstNode > i; --loop) {
+            const LoopSpan& l = loops[loop - 1];
+            bool read = false;
+            for (int e : l.exit)
+                if (e >= l.firstNode && e < l.endNode && u.live[e] && isGate(g[e].op)) read = true;
+            if (read)
+                for (int e : l.entry) use(e);
+        }
+        const Bit& b = g[i];
+        if (!u.live[i] || !isGate(b.op)) continue;
+        ++u.gates;
+        use(b.lhs);
+        if (b.op != Op::Not) use(b.rhs);
+    }
+    return u;
+}
+
+// Builds the next graph. Each builder applies the identities that only need
+// the operands' own nodes; rules that depend on fanout are decided by the
+// caller against the previous graph.
+class Builder {
+public:
+    std::vector<Bit> g;
+
+    int leaf(const Bit& b) {
+        g.push_back(b);
+        return static_cast<int>(g.size()) - 1;
+    }
+
+    int mkNot(int a) {
+        if (a == 0 || a == 1) return 1 - a;
+        if (g[a].op == Op::Not) return g[a].lhs;
+        return add(Op::Not, a, -1);
+    }
+
+    int mkAnd(int a, int b) {
+        if (a == 0 || b == 0) return 0;
+        if (a == 1) return b;
+        if (b == 1) return a;
+        if (a == b) return a;
+        if (complementary(a, b)) return 0;
+        for (int pass = 0; pass < 2; ++pass, std::swap(a, b)) {
+            Bit y = g[b];
+            if (y.op == Op::Or && (y.lhs == a || y.rhs == a)) return a;
+            if (y.op == Op::And && (y.lhs == a || y.rhs == a)) return b;
+            if (y.op == Op::And && (complementary(y.lhs, a) || complementary(y.rhs, a))) return 0;
+            if (y.op == Op::Or && complementary(y.lhs, a)) return mkAnd(a, y.rhs);
+            if (y.op == Op::Or && complementary(y.rhs, a)) return mkAnd(a, y.lhs);
+        }
+        return add(Op::And, a, b);
+    }
+
+    int mkOr(int a, int b) {
+        if (a == 1 || b == 1) return 1;
+        if (a == 0) return b;
+        if (b == 0) return a;
+        if (a == b) return a;
+        if (complementary(a, b)) return 1;
+        for (int pass = 0; pass < 2; ++pass, std::swap(a, b)) {
+            Bit y = g[b];
+            if (y.op == Op::And && (y.lhs == a || y.rhs == a)) return a;
+            if (y.op == Op::Or && (y.lhs == a || y.rhs == a)) return b;
+            if (y.op == Op::Or && (complementary(y.lhs, a) || complementary(y.rhs, a))) return 1;
+            if (y.op == Op::And && complementary(y.lhs, a)) return mkOr(a, y.rhs);
+            if (y.op == Op::And && complementary(y.rhs, a)) return mkOr(a, y.lhs);
+        }
+        return add(Op::Or, a, b);
+    }
+
+    int mkXor(int a, int b) {
+        if (a == 0) return b;
+        if (b == 0) return a;
+        if (a == 1) return mkNot(b);
+        if (b == 1) return mkNot(a);
+        if (a == b) return 0;
+        if (complementary(a, b)) return 1;
+        if (g[a].op == Op::Not && g[b].op == Op::Not) return mkXor(g[a].lhs, g[b].lhs);
+        for (int pass = 0; pass < 2; ++pass, std::swap(a, b)) {
+            Bit y = g[b];
+            if (y.op == Op::Xor && y.lhs == a) return y.rhs;
+            if (y.op == Op::Xor && y.rhs == a) return y.lhs;
+        }
+        return add(Op::Xor, a, b);
+    }
+
+    int make(Op op, int a, int b) {
+        switch (op) {
+            case Op::And: return mkAnd(a, b);
+            case Op::Or:  return mkOr(a, b);
+            case Op::Xor: return mkXor(a, b);
+            default:      return mkNot(a);
+        }
+    }
+
+private:
+    std::unordered_map<GateKey, int, GateKeyHash> table;
+
+    bool complementary(int a, int b) const {
+        return (g[a].op == Op::Not && g[a].lhs == b) || (g[b].op == Op::Not && g[b].lhs == a);
+    }
+
+    int add(Op op, int a, int b) {
+        auto it = table.find(keyOf(op, a, b));
+        if (it != table.end()) return it->second;
+        int ni = leaf(Bit{a, b, op});
+        table.emplace(keyOf(op, a, b), ni);
+        return ni;
+    }
+};
+
+// Carries out, loops and tracked over to built, the rebuilt graph, in which
+// node i of the old one became map[i] and startOf[i] nodes existed when i was
+// reached; a tracked bit with no counterpart becomes -1. Then compacts built
+// to what the outputs (or a loop that is still read) need, keeping constants
+// and inputs where they are and everything else in order.
+std::vector<Bit> finishRound(const std::vector<Bit>& built, const Usage& u, int leaves,
+                             const std::vector<int>& map, const std::vector<int>& startOf,
+                             std::vector<int>& out, std::vector<LoopSpan>& loops,
+                             std::vector<std::vector<int>>& tracked) {
+    int n = static_cast<int>(map.size());
+    auto remap = [&](std::vector<int>& v) {
+        for (int& e : v) e = (e < leaves || u.live[e]) ? map[e] : 0;
+    };
+    remap(out);
+    for (LoopSpan& l : loops) {
+        remap(l.entry);
+        remap(l.exit);
+        l.firstNode = startOf[std::min(l.firstNode, n)];
+        l.endNode = startOf[std::min(l.endNode, n)];
+    }
+    for (std::vector<int>& v : tracked)
+        for (int& e : v) e = e < 0 ? -1 : (e < leaves || u.live[e]) ? map[e] : -1;
+
+    Usage nu = usage(built, out, loops);
+    int m = static_cast<int>(built.size());
+    std::vector<int> pos(m + 1, 0);
+    std::vector<Bit> next;
+    next.reserve(m);
+    for (int i = 0; i < m; ++i) {
+        pos[i] = static_cast<int>(next.size());
+        if (i >= leaves && !nu.live[i]) continue;
+        Bit x = built[i];
+        if (isGate(x.op)) {
+            x.lhs = pos[x.lhs];
+            if (x.op != Op::Not) x.rhs = pos[x.rhs];
+        }
+        next.push_back(x);
+    }
+    pos[m] = static_cast<int>(next.size());
+
+    auto compact = [&](std::vector<int>& v) {
+        for (int& e : v) e = (e < leaves || nu.live[e]) ? pos[e] : 0;
+    };
+    compact(out);
+    for (LoopSpan& l : loops) {
+        compact(l.entry);
+        compact(l.exit);
+        l.firstNode = pos[l.firstNode];
+        l.endNode = pos[l.endNode];
+    }
+    for (std::vector<int>& v : tracked)
+        for (int& e : v) e = e < 0 ? -1 : (e < leaves || nu.live[e]) ? pos[e] : -1;
+    return next;
+}
+
+// XOR trees are flattened up to this many terms when looking for pairs that
+// cancel.
+constexpr size_t MaxXorTerms = 32;
+
+// One round: rebuilds g into a fresh graph, then compacts it to the nodes the
+// outputs still reach. out and loops are remapped to the result; so are the
+// bits in tracked, except that one the result no longer has becomes -1.
+std::vector<Bit> rewriteRound(const std::vector<Bit>& g, int leaves,
+                              std::vector<int>& out, std::vector<LoopSpan>& loops,
+                              std::vector<std::vector<int>>& tracked) {
+    int n = static_cast<int>(g.size());
+    Usage u = usage(g, out, loops);
+    Builder b;
+    b.g.reserve(n);
+    std::vector<int> map(n, 0);
+    std::vector<int> startOf(n + 1);
+    for (int i = 0; i < leaves; ++i) map[i] = b.leaf(g[i]);
+
+    auto singleNot = [&](int x) { return g[x].op == Op::Not && u.fanout[x] == 1; };
+
+    for (int i = leaves; i < n; ++i) {
+        startOf[i] = static_cast<int>(b.g.size());
+        if (!u.live[i]) continue;
+        const Bit& x = g[i];
+        switch (x.op) {
+            case Op::And:
+            case Op::Or:
+                // ~a & ~b = ~(a | b) and ~a | ~b = ~(a & b): one gate fewer
+                // when nothing else reads the inverters.
+                if (singleNot(x.lhs) && singleNot(x.rhs)) {
+                    Op dual = x.op == Op::And ? Op::Or : Op::And;
+                    map[i] = b.mkNot(b.make(dual, map[g[x.lhs].lhs], map[g[x.rhs].lhs]));
+                } else {
+                    map[i] = b.make(x.op, map[x.lhs], map[x.rhs]);
+                }
+                break;
+            case Op::Xor: {
+                // Collect the terms of the XOR tree rooted here. Gates read
+                // only from inside the tree go away if it is rebuilt.
+                std::vector<int> terms, stack{x.lhs, x.rhs};
+                int owned = 1;
+                while (!stack.empty()) {
+                    int t = stack.back();
+                    stack.pop_back();
+                    if (g[t].op == Op::Xor && terms.size() + stack.size() + 2 <= MaxXorTerms) {
+                        if (u.fanout[t] == 1) ++owned;
+                        stack.push_back(g[t].lhs);
+                        stack.push_back(g[t].rhs);
+                    } else {
+                        terms.push_back(t);
+                    }
+                }
+
+                int parity = 0, inverted = 0;
+                std::vector<int> mapped;
+                for (int t : terms) {
+                    int v = map[t];
+                    if (v == 0) continue;
+                    if (v == 1) { parity ^= 1; continue; }
+                    if (b.g[v].op == Op::Not) {
+                        parity ^= 1;
+                        ++inverted;
+                        v = b.g[v].lhs;
+                    }
+                    mapped.push_back(v);
+                }
+                std::sort(mapped.begin(), mapped.end());
+                std::vector<int> kept;
+                for (int v : mapped) {
+                    if (!kept.empty() && kept.back() == v) kept.pop_back();
+                    else kept.push_back(v);
+                }
+
+                bool cancelled = kept.size() < terms.size() || inverted >= 2;
+                int cost = std::max<int>(static_cast<int>(kept.size()) - 1, 0) + parity;
+                if (cancelled && cost <= owned) {
+                    int r = kept.empty() ? 0 : kept[0];
+                    for (size_t k = 1; k < kept.size(); ++k) r = b.mkXor(r, kept[k]);
+                    map[i] = parity ? b.mkNot(r) : r;
+                } else {
+                    map[i] = b.mkXor(map[x.lhs], map[x.rhs]);
+                }
+                break;
+            }
+            case Op::Not:
+                map[i] = b.mkNot(map[x.lhs]);
+                break;
+            default:
+                map[i] = b.leaf(x);
+                break;
+        }
+    }
+    startOf[n] = static_cast<int>(b.g.size());
+    return finishRound(b.g, u, leaves, map, startOf, out, loops, tracked);
+}
+
+// A linear node whose expansion would exceed this many terms is computed
+// from its operands as it stands, and the nodes after it expand it as one
+// term.
+constexpr size_t MaxLinearTerms = 64;
+
+// A linear layer factored by Paar's heuristic: pairs[k] is XORed into
+// variable count + k, and each row XORs the variables it lists.
+struct Factoring {
+    std::vector<std::pair<int, int>> pairs;
+    std::vector<std::vector<int>> rows;
+
+    int xors() const {
+        int n = static_cast<int>(pairs.size());
+        for (const std::vector<int>& r : rows) n += std::max<int>(static_cast<int>(r.size()) - 1, 0);
+        return n;
+    }
+};
+
+// Paar's greedy factoring. rows[t] lists the variables (0 to count - 1) that
+// row t XORs together. While some pair of variables occurs together in two or
+// more rows, the most frequent pair is XORed once and becomes a variable
+// itself.
+Factoring factorRows(int count, std::vector<std::vector<int>> rows) {
+    auto pairKey = [](int x, int y) {
+        return (static_cast<uint64_t>(std::min(x, y)) << 32) | static_cast<uint32_t>(std::max(x, y));
+    };
+    std::unordered_map<uint64_t, int> pairCount;
+    std::priority_queue<std::pair<int, uint64_t>> heap;
+    std::vector<std::vector<int>> holders(count);
+    for (size_t t = 0; t < rows.size(); ++t) {
+        const std::vector<int>& vs = rows[t];
+        for (size_t i = 0; i < vs.size(); ++i) {
+            holders[vs[i]].push_back(static_cast<int>(t));
+            for (size_t j = i + 1; j < vs.size(); ++j) ++pairCount[pairKey(vs[i], vs[j])];
+        }
+    }
+    for (const auto& [key, c] : pairCount)
+        if (c >= 2) heap.push({c, key});
+    auto bump = [&](int x, int y, int d) {
+        uint64_t key = pairKey(x, y);
+        int c = pairCount[key] += d;
+        if (c == 0) pairCount.erase(key);
+        else if (d > 0 && c >= 2) heap.push({c, key});
+    };
+
+    Factoring f;
+    while (!heap.empty()) {
+        auto [c, key] = heap.top();
+        heap.pop();
+        auto it = pairCount.find(key);
+        if (it == pairCount.end() || it->second != c) continue;
+        int x = static_cast<int>(key >> 32), y = static_cast<int>(key & 0xFFFFFFFFu);
+        int z = count + static_cast<int>(f.pairs.size());
+        f.pairs.push_back({x, y});
+        holders.emplace_back();
+        for (int t : holders[x]) {
+            std::vector<int>& vs = rows[t];
+            if (!std::binary_search(vs.begin(), vs.end(), x) || !std::binary_search(vs.begin(), vs.end(), y)) continue;
+            for (int v : vs) {
+                if (v == x || v == y) continue;
+                bump(x, v, -1);
+                bump(y, v, -1);
+                bump(z, v, 1);
+            }
+            bump(x, y, -1);
+            vs.erase(std::remove_if(vs.begin(), vs.end(), [&](int v) { return v == x || v == y; }), vs.end());
+            vs.push_back(z);
+            holders[z].push_back(t);
+        }
+    }
+    f.rows = std::move(rows);
+    return f;
+}
+
+// One round of linear layer factoring. XOR and NOT are affine over GF(2), so
+// every XOR/NOT node is a parity of the non-linear nodes (AND, OR, inputs)
+// below it, plus a constant. Only the XOR/NOT nodes something outside their
+// layer reads, the targets, need to exist. A layer is the XOR/NOT nodes with
+// the same number of non-linear gates on their deepest path; for each depth
+// the non-linear gates are built, then the layer's targets are factored
+// together from their parities, or the layer is copied as it stands when
+// that is no more XORs. Loop spans are factored separately from the gates
+// around them so that every loop still starts and ends between nodes.
+std::vector<Bit> linearRound(const std::vector<Bit>& g, int leaves,
+                             std::vector<int>& out, std::vector<LoopSpan>& loops,
+                             std::vector<std::vector<int>>& tracked) {
+    int n = static_cast<int>(g.size());
+    Usage u = usage(g, out, loops);
+
+    std::vector<int> cuts{leaves, n};
+    for (const LoopSpan& l : loops)
+        for (int c : {l.firstNode, l.endNode}) cuts.push_back(std::clamp(c, leaves, n));
+    std::sort(cuts.begin(), cuts.end());
+    cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+    std::vector<int> segment(n, -1);
+    for (size_t s = 0; s + 1 < cuts.size(); ++s)
+        std::fill(segment.begin() + cuts[s], segment.begin() + cuts[s + 1], static_cast<int>(s));
+
+    // Parities. A term from another segment stays a term of its own.
+    std::vector<char> linear(n, 0), target(n, 0), parity(n, 0);
+    std::vector<std::vector<int>> form(n);
+    for (int i = leaves; i < n; ++i) {
+        const Bit& x = g[i];
+        if (!u.live[i] || (x.op != Op::Xor && x.op != Op::Not)) continue;
+        auto termsOf = [&](int o, std::vector<int>& t, char& p) {
+            if (linear[o] && segment[o] == segment[i]) {
+                t = form[o];
+                p = parity[o];
+            } else {
+                t = {o};
+                p = 0;
+            }
+        };
+        std::vector<int> a, c;
+        char pa = 0, pc = 0;
+        termsOf(x.lhs, a, pa);
+        if (x.op == Op::Not) {
+            form[i] = std::move(a);
+            parity[i] = pa ^ 1;
+        } else {
+            termsOf(x.rhs, c, pc);
+            std::set_symmetric_difference(a.begin(), a.end(), c.begin(), c.end(), std::back_inserter(form[i]));
+            parity[i] = pa ^ pc;
+        }
+        if (form[i].size() > MaxLinearTerms) form[i].clear();
+        else linear[i] = 1;
+    }
+
+    auto mark = [&](int i) {
+        if (i >= 0 && linear[i]) target[i] = 1;
+    };
+    for (int o : out) mark(o);
+    for (const LoopSpan& l : loops) {
+        for (int e : l.entry) mark(e);
+        for (int e : l.exit) mark(e);
+    }
+    for (const std::vector<int>& v : tracked)
+        for (int e : v) mark(e);
+    std::vector<int> depth(n, 0);
+    int maxDepth = 0;
+    for (int i = leaves; i < n; ++i) {
+        const Bit& x = g[i];
+        if (!u.live[i] || !isGate(x.op)) continue;
+        int d = 0;
+        for (int o : {x.lhs, x.op == Op::Not ? x.lhs : x.rhs})
+            if (segment[o] == segment[i]) d = std::max(d, depth[o]);
+        depth[i] = linear[i] ? d : d + 1;
+        maxDepth = std::max(maxDepth, depth[i]);
+        for (int o : {x.lhs, x.op == Op::Not ? x.lhs : x.rhs})
+            if (!linear[i] || segment[o] != segment[i] || depth[o] != depth[i]) mark(o);
+    }
+
+    Builder b;
+    b.g.reserve(n);
+    std::vector<int> map(n, -1);
+    std::vector<int> startOf(n + 1);
+    for (int i = 0; i < leaves; ++i) map[i] = b.leaf(g[i]);
+
+    std::vector<std::vector<int>> gates(maxDepth + 1), layer(maxDepth + 1);
+    for (size_t s = 0; s + 1 < cuts.size(); ++s) {
+        std::fill(startOf.begin() + cuts[s], startOf.begin() + cuts[s + 1], static_cast<int>(b.g.size()));
+        for (int i = cuts[s]; i < cuts[s + 1]; ++i) {
+            if (!u.live[i]) continue;
+            (linear[i] ? layer : gates)[depth[i]].push_back(i);
+        }
+        for (int d = 0; d <= maxDepth; ++d) {
+            for (int i : gates[d]) {
+                const Bit& x = g[i];
+                map[i] = isGate(x.op) ? b.make(x.op, map[x.lhs], map[x.op == Op::Not ? x.lhs : x.rhs]) : b.leaf(x);
+            }
+            gates[d].clear();
+            if (layer[d].empty()) continue;
+
+            std::vector<int> targets, vars, slot;
+            std::unordered_map<int, int> varOf;
+            std::map<std::pair<std::vector<int>, char>, int> unique;
+            std::vector<std::vector<int>> rows;
+            std::vector<char> inverted;
+            for (int i : layer[d]) {
+                if (!target[i]) continue;
+                std::vector<int> vs;
+                for (int t : form[i]) {
+                    auto [it, fresh] = varOf.emplace(t, static_cast<int>(vars.size()));
+                    if (fresh) vars.push_back(map[t]);
+                    vs.push_back(it->second);
+                }
+                std::sort(vs.begin(), vs.end());
+                auto [it, fresh] = unique.emplace(std::make_pair(vs, parity[i]), static_cast<int>(rows.size()));
+                if (fresh) {
+                    rows.push_back(std::move(vs));
+                    inverted.push_back(parity[i]);
+                }
+                targets.push_back(i);
+                slot.push_back(it->second);
+            }
+            Factoring f = factorRows(static_cast<int>(vars.size()), std::move(rows));
+            int factored = f.xors() + static_cast<int>(std::count(inverted.begin(), inverted.end(), 1));
+
+            if (factored >= static_cast<int>(layer[d].size())) {
+                for (int i : layer[d]) map[i] = b.make(g[i].op, map[g[i].lhs], map[g[i].op == Op::Not ? g[i].lhs : g[i].rhs]);
+            } else {
+                for (auto [x, y] : f.pairs) vars.push_back(b.mkXor(vars[x], vars[y]));
+                std::vector<int> nodes;
+                for (size_t r = 0; r < f.rows.size(); ++r) {
+                    int v = 0;
+                    for (int t : f.rows[r]) v = b.mkXor(v, vars[t]);
+                    nodes.push_back(inverted[r] ? b.mkNot(v) : v);
+                }
+                for (size_t k = 0; k < targets.size(); ++k) map[targets[k]] = nodes[slot[k]];
+            }
+            layer[d].clear();
+        }
+    }
+    startOf[n] = static_cast<int>(b.g.size());
+    return finishRound(b.g, u, leaves, map, startOf, out, loops, tracked);
+}
+
+using Round = std::vector<Bit> (*)(const std::vector<Bit>&, int, std::vector<int>&,
+                                   std::vector<LoopSpan>&, std::vector<std::vector<int>>&);
+
+// Runs round over bitMapping up to maxRounds times, keeping each result that
+// has no more live gates than the last, then writes the graph, gateTable,
+// loopRegions, wordOps, tableOps and fieldOps back.
+RewriteReport runRounds(CompilationContext& cx, Round round, int maxRounds, std::vector<int>& out) {
+    int leaves = 2;
+    while (leaves < static_cast<int>(cx.bitMapping.size()) && cx.bitMapping[leaves].op == Op::Input) ++leaves;
+
+    std::vector<LoopSpan> loops;
+    for (const LoopRegion& r : cx.loopRegions) loops.push_back({r.firstNode, r.endNode, r.entry, r.exit});
+    std::vector<std::vector<int>> tracked;
+    for (const WordOp& op : cx.wordOps) {
+        tracked.push_back(op.lhs);
+        tracked.push_back(op.rhs);
+        tracked.push_back(op.sum);
+    }
+    for (const TableOp& op : cx.tableOps) {
+        tracked.push_back(op.in);
+        tracked.push_back(op.out);
+    }
+    for (const FieldOp& op : cx.fieldOps) {
+        tracked.push_back(op.lhs);
+        tracked.push_back(op.rhs);
+        tracked.push_back(op.out);
+    }
+
+    RewriteReport report;
+    report.gatesBefore = usage(cx.bitMapping, out, loops).gates;
+    int gates = report.gatesBefore;
+    std::vector<Bit> g = cx.bitMapping;
+
+    for (int r = 0; r < maxRounds; ++r) {
+        std::vector<int> nextOut = out;
+        std::vector<LoopSpan> nextLoops = loops;
+        std::vector<std::vector<int>> nextTracked = tracked;
+        std::vector<Bit> next = round(g, leaves, nextOut, nextLoops, nextTracked);
+        int nextGates = usage(next, nextOut, nextLoops).gates;
+        if (nextGates > gates) break;
+
+        g = std::move(next);
+        out = std::move(nextOut);
+        loops = std::move(nextLoops);
+        tracked = std::move(nextTracked);
+        ++report.rounds;
+        if (nextGates == gates) break;
+        gates = nextGates;
+    }
+    report.gatesAfter = gates;
+
+    cx.bitMapping = std::move(g);
+    cx.gateTable.clear();
+    for (size_t i = 0; i < cx.bitMapping.size(); ++i) {
+        const Bit& x = cx.bitMapping[i];
+        if (isGate(x.op)) cx.gateTable.emplace(keyOf(x.op, x.lhs, x.rhs), static_cast<int>(i));
+    }
+
+    std::vector<LoopRegion> kept;
+    for (size_t r = 0; r < cx.loopRegions.size(); ++r) {
+        const LoopSpan& l = loops[r];
+        bool read = false;
+        for (int e : l.exit)
+            if (e >= l.firstNode && e < l.endNode && isGate(cx.bitMapping[e].op)) read = true;
+        if (!read) continue;
+        LoopRegion region = std::move(cx.loopRegions[r]);
+        region.firstNode = l.firstNode;
+        region.endNode = l.endNode;
+        region.entry = l.entry;
+        region.exit = l.exit;
+        kept.push_back(std::move(region));
+    }
+    cx.loopRegions = std::move(kept);
+
+    // A word op or lookup whose operands are gone can no longer be computed
+    // directly.
+    auto whole = [](const std::vector<int>& v) { return std::none_of(v.begin(), v.end(), [](int b) { return b < 0; }); };
+    auto read = [](const std::vector<int>& v) { return std::any_of(v.begin(), v.end(), [](int b) { return b >= 0; }); };
+    std::vector<WordOp> ops;
+    for (size_t k = 0; k < cx.wordOps.size(); ++k) {
+        WordOp op{cx.wordOps[k].kind, tracked[3 * k], tracked[3 * k + 1], tracked[3 * k + 2]};
+        if (whole(op.lhs) && whole(op.rhs) && read(op.sum)) ops.push_back(std::move(op));
+    }
+    size_t base = 3 * cx.wordOps.size();
+    std::vector<TableOp> lookups;
+    for (size_t k = 0; k < cx.tableOps.size(); ++k) {
+        TableOp op{cx.tableOps[k].table, tracked[base + 2 * k], tracked[base + 2 * k + 1]};
+        if (whole(op.in) && read(op.out)) lookups.push_back(std::move(op));
+    }
+    base += 2 * cx.tableOps.size();
+    std::vector<FieldOp> products;
+    for (size_t k = 0; k < cx.fieldOps.size(); ++k) {
+        FieldOp op{cx.fieldOps[k].field, tracked[base + 3 * k], tracked[base + 3 * k + 1], tracked[base + 3 * k + 2]};
+        if (whole(op.lhs) && whole(op.rhs) && read(op.out)) products.push_back(std::move(op));
+    }
+    cx.wordOps = std::move(ops);
+    cx.tableOps = std::move(lookups);
+    cx.fieldOps = std::move(products);
+    return report;
+}
+
+} // namespace
+
+RewriteReport rewriteGraph(CompilationContext& cx, std::vector<int>& out) {
+    return runRounds(cx, rewriteRound, 32, out);
+}
+
+RewriteReport factorLinearLayers(CompilationContext& cx, std::vector<int>& out) {
+    RewriteReport report = runRounds(cx, linearRound, 1, out);
+    if (report.gatesAfter == report.gatesBefore) return report;
+    RewriteReport tidy = rewriteGraph(cx, out);
+    report.gatesAfter = tidy.gatesAfter;
+    report.rounds += tidy.rounds;
+    return report;
+}
+
+RewriteReport optimizeGraph(CompilationContext& cx, std::vector<int>& out, int level) {
+    if (level <= 0) return RewriteReport{};
+    RewriteReport report = level >= 2 ? synthesizeGraph(cx, out) : rewriteGraph(cx, out);
+    RewriteReport linear = factorLinearLayers(cx, out);
+    report.gatesAfter = linear.gatesAfter;
+    report.rounds += linear.rounds;
+    return report;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <vector>
+
+struct CompilationContext;
+
+// Live gate counts around a call to rewriteGraph, and how many rounds of
+// rewriting it took to reach a fixpoint.
+struct RewriteReport {
+    int gatesBefore = 0;
+    int gatesAfter = 0;
+    int rounds = 0;
+    int removed() const { return gatesBefore - gatesAfter; }
+};
+
+// Simplifies the gate graph SemanticAnalyzer::analyze left in cx with local
+// Boolean identities: a^a = 0, a&a = a, a&~a = 0, ~~a = a, absorption,
+// cancellation inside XOR chains and De Morgan on single-use inverters. Every
+// round rebuilds bitMapping in index order and drops gates the outputs no
+// longer reach; rounds repeat until the live gate count stops falling.
+//
+// out is rewritten in place and keeps its order. Constants and inputs keep
+// their indices; gateTable, loopRegions, wordOps, tableOps and fieldOps are
+// updated to match. A loop none of whose exit bits is still read is dropped,
+// and so is a word op, lookup or field multiply whose operands no longer all
+// exist.
+RewriteReport rewriteGraph(CompilationContext& cx, std::vector<int>& out);
+
+// Re-derives the linear layers of the graph. Every XOR/NOT node that a
+// non-linear gate, an output, a loop or a word op reads is expanded into the
+// parity of the AND/OR gates and inputs below it, and the parities of all
+// such nodes at the same AND/OR depth are rebuilt together as one GF(2)
+// matrix, with Paar's heuristic: the pair of terms shared by the most rows is
+// XORed once and reused, until no pair is shared. A layer that comes out no
+// smaller is left as written, and loop spans are factored apart from the
+// gates around them. The result is kept unless it has more live gates, and is
+// cleaned up with rewriteGraph when it has fewer.
+RewriteReport factorLinearLayers(CompilationContext& cx, std::vector<int>& out);
+
+// Runs the passes for an optimization level: 0 leaves the graph alone, 1 runs
+// rewriteGraph and 2 runs synthesizeGraph (aig.hpp), which includes it. Both
+// finish with factorLinearLayers.
+RewriteReport optimizeGraph(CompilationContext& cx, std::vector<int>& out, int level);
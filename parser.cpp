@@ -1,11 +1,13 @@
 #include "parser.hpp"
+#include <cctype>
+#include <climits>
 #include <stdexcept>
 #include <iostream>
 
 Parser::Parser(const std::vector<Token>& toks) : tokens(toks) {}
 
 const Token& Parser::peek(int off) const {
-    static Token dummy{TokenType::END_OF_FILE, "", 0, 0};
+    static Token dummy{TokenType::END_OF_FILE, "", 0, 0, Literal{}};
     size_t i = pos + off;
     return i < tokens.size() ? tokens[i] : dummy;
 }
@@ -24,7 +26,7 @@ const Token& Parser::expect(TokenType t, const std::string& v) {
     if (peek().type == t && (v.empty() || peek().value == v))
         return tokens[pos++];
     throw std::runtime_error(
-        "Unexpected token : " + peek().value + " -> at line and col : " +
+        "Unexpected token : " + std::string(peek().value) + " -> at line and col : " +
         std::to_string(peek().line) + " " + std::to_string(peek().col));
 }
 
@@ -32,6 +34,7 @@ const Token& Parser::expect(TokenType t, const std::string& v) {
 
 Program Parser::parseProgram() {
     Program prog;
+    arena = &prog.arena;
     while (!eof()) {
         if (match(TokenType::SEMICOLON)) continue;
         prog.decls.push_back(parseDecl());
@@ -43,175 +46,273 @@ Program Parser::parseProgram() {
 
 DeclPtr Parser::parseDecl() {
     if (match(TokenType::FUNCTION)) return parseFunc();
-    throw std::runtime_error("Unexpected top level declaration : " + peek().value +
+    if (match(TokenType::TABLE)) return parseTable();
+    if (match(TokenType::FIELD)) return parseField();
+    throw std::runtime_error("Unexpected top level declaration : " + std::string(peek().value) +
                              " -> at line and col : " + std::to_string(peek().line) +
                              " : " + std::to_string(peek().col));
 }
 
-std::unique_ptr<FuncDecl> Parser::parseFunc() {
-    auto decl = std::make_unique<FuncDecl>();
+FuncDecl* Parser::parseFunc() {
+    auto decl = arena->make<FuncDecl>();
     decl->name = expect(TokenType::IDENTIFIER).value;
     if(decl -> name == "main"){
         expect(TokenType::COLON);
-        std::string argc;
-        int counter = 0;
-        for(auto c:expect(TokenType::DATA).value){
-            if(counter < 4){counter++; continue;}
-            if(c != ')') argc.push_back(c);
-        }
-        decl->argc = argc;
+        decl->argc = intLiteral(expect(TokenType::DATA), "argc");
     }
     else{
-        decl -> argc = "-1";
+        decl -> argc = -1;
     }
     decl->body = parseBlock();
     return decl;
 }
 
+// Entries are plain numbers in either radix, separated by commas, and there
+// must be exactly one per index.
+TableDecl* Parser::parseTable() {
+    auto decl = arena->make<TableDecl>();
+    const Token& nameTok = expect(TokenType::IDENTIFIER);
+    decl->name = nameTok.value;
+    expect(TokenType::COLON);
+    decl->inBits = intLiteral(expect(TokenType::DATA), "table input width");
+    expect(TokenType::ARROW);
+    decl->outBits = intLiteral(expect(TokenType::DATA), "table output width");
+    if (decl->inBits < 1 || decl->inBits > 16 || decl->outBits < 1 || decl->outBits > 64)
+        throw std::runtime_error("Table " + decl->name + " must map 1-16 bits to 1-64 bits -> at line and col : " +
+                                 std::to_string(nameTok.line) + " " + std::to_string(nameTok.col));
+
+    size_t count = size_t{1} << decl->inBits;
+    uint64_t* entries = arena->array<uint64_t>(count);
+    size_t n = 0;
+    expect(TokenType::OPEN_BRACE);
+    while (peek().type != TokenType::CLOSE_BRACE) {
+        if (n > 0) expect(TokenType::COMMA);
+        if (peek().type == TokenType::CLOSE_BRACE) break;
+        const Token& tok = expect(TokenType::DATA);
+        if (!tok.literal.fits || (decl->outBits < 64 && tok.literal.number >> decl->outBits))
+            throw std::runtime_error("Invalid table entry : " + std::string(tok.value) +
+                                     " -> at line and col : " + std::to_string(tok.line) +
+                                     " " + std::to_string(tok.col));
+        if (n < count) entries[n] = tok.literal.number;
+        ++n;
+    }
+    expect(TokenType::CLOSE_BRACE);
+    if (n != count)
+        throw std::runtime_error("Table " + decl->name + " needs " + std::to_string(count) + " entries, got " +
+                                 std::to_string(n));
+    decl->entries = entries;
+    return decl;
+}
+
+// The reduction polynomial is written without its x^n term, so it is below
+// 2^n and at most 64 bits.
+FieldDecl* Parser::parseField() {
+    auto decl = arena->make<FieldDecl>();
+    const Token& nameTok = expect(TokenType::IDENTIFIER);
+    decl->name = nameTok.value;
+    expect(TokenType::COLON);
+    decl->bits = intLiteral(expect(TokenType::DATA), "field width");
+    if (decl->bits < 1 || decl->bits > 128)
+        throw std::runtime_error("Field " + decl->name + " must be 1-128 bits wide -> at line and col : " +
+                                 std::to_string(nameTok.line) + " " + std::to_string(nameTok.col));
+    expect(TokenType::EQ);
+    const Token& tok = expect(TokenType::DATA);
+    if (!tok.literal.fits || (decl->bits < 64 && tok.literal.number >> decl->bits))
+        throw std::runtime_error("Invalid reduction polynomial : " + std::string(tok.value) +
+                                 " -> at line and col : " + std::to_string(tok.line) +
+                                 " " + std::to_string(tok.col));
+    decl->poly = tok.literal.number;
+    expect(TokenType::SEMICOLON);
+    return decl;
+}
+
 // STATEMENTS ========================================================
 
 StmtPtr Parser::parseStmt() {
     while (match(TokenType::SEMICOLON)) {}
     if (match(TokenType::RETURN)) return parseReturn();
+    if (match(TokenType::REPEAT)) return parseRepeat();
     if (peek().type == TokenType::IDENTIFIER) return parseAssignStmt();
-    throw std::runtime_error("Unexpected token in statement: " + peek().value +
+    throw std::runtime_error("Unexpected token in statement: " + std::string(peek().value) +
                              " -> at line and col : " + std::to_string(peek().line) +
                              " : " + std::to_string(peek().col));
 }
 
-std::unique_ptr<ReturnStmt> Parser::parseReturn() {
-    auto result = std::make_unique<ReturnStmt>(parsePrimitive());
+ReturnStmt* Parser::parseReturn() {
+    auto result = arena->make<ReturnStmt>(parsePrimitive());
     expect(TokenType::SEMICOLON);
     return result;
 }
 
-std::vector<StmtPtr> Parser::parseBlock() {
+RepeatStmt* Parser::parseRepeat() {
+    int count = intLiteral(expect(TokenType::DATA), "repeat count");
+    return arena->make<RepeatStmt>(count, parseBlock());
+}
+
+AstList<Stmt> Parser::parseBlock() {
     expect(TokenType::OPEN_BRACE);
     std::vector<StmtPtr> stmts;
     while (!eof() && peek().type != TokenType::CLOSE_BRACE) {
+        if (match(TokenType::SEMICOLON)) continue;
         StmtPtr stmt = parseStmt();
-        if (stmt) stmts.push_back(std::move(stmt));
+        if (stmt) stmts.push_back(stmt);
         else ++pos;
     }
     expect(TokenType::CLOSE_BRACE);
-    return stmts;
+    return arena->list(stmts);
 }
 
 // EXPRESSIONS ========================================================
 
 StmtPtr Parser::parseAssignStmt(){
-    auto identifier = std::make_unique<VarExpr>(expect(TokenType::IDENTIFIER).value);
-    auto lhs = parseIndentiferFamily(std::move(identifier));
+    auto identifier = arena->make<VarExpr>(std::string(expect(TokenType::IDENTIFIER).value));
+    auto lhs = parseIndentiferFamily(identifier);
     expect(TokenType::EQ);
     auto rhs = parseRHS();
-    return std::make_unique<AssignStmt>(
-        std::move(lhs),
-        std::move(rhs)
+    return arena->make<AssignStmt>(
+        lhs,
+        rhs
     );
 }
 
 ExprPtr Parser::parseRHS(){
     if (peek().type == TokenType::TILDE){
-        std::string op = tokens[pos++].value;
+        std::string op(tokens[pos++].value);
         auto sub = parsePrimitive();
-        return std::make_unique<NotExpr>(std::move(sub));
+        return arena->make<NotExpr>(sub);
     }
     else if(peek().type == TokenType::IDENTIFIER){
-        auto identifier = std::make_unique<VarExpr>(expect(TokenType::IDENTIFIER).value);
+        auto identifier = arena->make<VarExpr>(std::string(expect(TokenType::IDENTIFIER).value));
         if (peek().type == TokenType::OPEN_PAREN) 
-            return parseCallExpr(std::move(identifier));
-        auto lop = parseIndentiferFamily(std::move(identifier));
+            return parseCallExpr(identifier);
+        auto lop = parseIndentiferFamily(identifier);
         
         if(peek().type == TokenType::SEMICOLON) return lop;
 
         if (peek().type == TokenType::CONCAT) {
             std::vector<ExprPtr> operands;
-            operands.push_back(std::move(lop));
+            operands.push_back(lop);
             while (match(TokenType::CONCAT)) {
                 operands.push_back(parsePrimitive());
             }
             if (operands.size() > 1)
-                return std::make_unique<ConcatExpr>(std::move(operands));
+                return arena->make<ConcatExpr>(arena->list(operands));
         }
 
-        std::string op = tokens[pos++].value;
+        std::string op(tokens[pos++].value);
         if(!isBinaryOp(op)) throw std::runtime_error("Invalid binary operator : "+op);
         auto rop = parsePrimitive();
 
-        return std::make_unique<BinaryExpr>(op, std::move(lop), std::move(rop));
+        return arena->make<BinaryExpr>(op, lop, rop);
     }
     else if(peek().type == TokenType::DATA){
-        auto lop = std::make_unique<DataExpr>(expect(TokenType::DATA).value);
+        auto lop = parseData();
         if(peek().type == TokenType::SEMICOLON) return lop;
         if (peek().type == TokenType::CONCAT) {
             std::vector<ExprPtr> operands;
-            operands.push_back(std::move(lop));
+            operands.push_back(lop);
             while (match(TokenType::CONCAT)) {
                 operands.push_back(parsePrimitive());
             }
             if (operands.size() > 1)
-                return std::make_unique<ConcatExpr>(std::move(operands));
+                return arena->make<ConcatExpr>(arena->list(operands));
         }
 
-        std::string op = tokens[pos++].value;
+        std::string op(tokens[pos++].value);
         if(!isBinaryOp(op)) throw std::runtime_error("Invalid bianry operator : "+op);
         auto rop = parsePrimitive();
 
-        return std::make_unique<BinaryExpr>(op, std::move(lop), std::move(rop));
+        return arena->make<BinaryExpr>(op, lop, rop);
     }
-    else throw std::runtime_error("Invalid expression : " + peek().value);
+    else throw std::runtime_error("Invalid expression : " + std::string(peek().value));
 }
 
 ExprPtr Parser::parsePrimitive(){
     if(peek().type == TokenType::IDENTIFIER){
-        auto identifier = std::make_unique<VarExpr>(expect(TokenType::IDENTIFIER).value);
+        auto identifier = arena->make<VarExpr>(std::string(expect(TokenType::IDENTIFIER).value));
         if(peek().type == TokenType::OPEN_PAREN) throw std::runtime_error("Primitive expression cannot have function call");
-        return parseIndentiferFamily(std::move(identifier));
+        return parseIndentiferFamily(identifier);
     }
     else if(peek().type == TokenType::DATA){
-        return std::make_unique<DataExpr>(expect(TokenType::DATA).value);
+        return parseData();
     }
-    else throw std::runtime_error("Primitive expression invalid "+peek().value);
+    else throw std::runtime_error("Primitive expression invalid " + std::string(peek().value));
 }
 
 ExprPtr Parser::parseIndentiferFamily(ExprPtr identifier){
     if(peek().type == TokenType::SEMICOLON) return identifier;
-    ExprPtr node = std::move(identifier);
+    ExprPtr node = identifier;
     if(match(TokenType::OPEN_SQR)){
-        std::string start;
-        std::string end;
-        if (peek().type == TokenType::COLON || peek().type == TokenType::CLOSE_SQR) {
-            start = "bit(0)";
-        } else {
-            start =  expect(TokenType::DATA).value;
+        int start = 0;
+        int end = -1;
+        if (peek().type != TokenType::COLON && peek().type != TokenType::CLOSE_SQR) {
+            start = intLiteral(expect(TokenType::DATA), "index");
         }
         if (match(TokenType::COLON)) {
-            if (peek().type == TokenType::CLOSE_SQR) {
-                end = "bit(-1)";
-            } else {
-                end = expect(TokenType::DATA).value;
+            if (peek().type != TokenType::CLOSE_SQR) {
+                end = intLiteral(expect(TokenType::DATA), "index");
             }
             expect(TokenType::CLOSE_SQR);
-            node = std::make_unique<SliceExpr>(std::move(node), start, end);
+            node = arena->make<SliceExpr>(node, start, end);
         } else {
             expect(TokenType::CLOSE_SQR);
-            node = std::make_unique<IndexExpr>(std::move(node), start);
+            node = arena->make<IndexExpr>(node, start);
         }
     }
     return node;
 }
 
 
+// LITERALS ========================================================
+
+int Parser::intLiteral(const Token& tok, const char* what) {
+    if (!tok.literal.fits || tok.literal.number > static_cast<uint64_t>(INT_MAX))
+        throw std::runtime_error(std::string("Invalid ") + what + " : " + std::string(tok.value) +
+                                 " -> at line and col : " + std::to_string(tok.line) +
+                                 " " + std::to_string(tok.col));
+    return static_cast<int>(tok.literal.number);
+}
+
+DataExpr* Parser::parseData() {
+    const Token& tok = expect(TokenType::DATA);
+    std::string_view digits = tok.digits();
+    bool decimal = tok.literal.base == 10;
+
+    BitLiteral bits;
+    bits.width = static_cast<int>(digits.size()) * (decimal ? 1 : 4);
+    uint64_t* words = arena->array<uint64_t>((bits.width + 63) / 64);
+    int at = 0;
+    for (char c : digits) {
+        if (decimal) {
+            if (c != '0') words[at >> 6] |= 1ULL << (63 - (at & 63));
+            ++at;
+        } else {
+            uint64_t v = std::isdigit(static_cast<unsigned char>(c))
+                ? c - '0'
+                : std::tolower(static_cast<unsigned char>(c)) - 'a' + 10;
+            words[at >> 6] |= v << (60 - (at & 63));
+            at += 4;
+        }
+    }
+    bits.words = words;
+
+    int amount = -1;
+    if (decimal && tok.literal.fits && tok.literal.number <= static_cast<uint64_t>(INT_MAX))
+        amount = static_cast<int>(tok.literal.number);
+    return arena->make<DataExpr>(bits, decimal, amount);
+}
+
 ExprPtr Parser::parseCallExpr(ExprPtr identifier){
     expect(TokenType::OPEN_PAREN);
     ExprPtr arg = parsePrimitive();
+    ExprPtr arg2 = match(TokenType::COMMA) ? parsePrimitive() : nullptr;
     expect(TokenType::CLOSE_PAREN);
-    return std::make_unique<CallExpr>(std::move(identifier), std::move(arg));
+    return arena->make<CallExpr>(identifier, arg, arg2);
 }
 
 bool Parser::isBinaryOp(const std::string& op) const {
     static const std::vector<std::string> ops = {
-        "|", "&", "^",
+        "|", "&", "^", "+", "-",
         "==", "!=", "&&", "||", "<<", ">>",
         "<<<", ">>>"
     };
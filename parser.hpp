@@ -1,7 +1,6 @@
 #pragma once
 #include <vector>
 #include <string>
-#include <memory>
 #include "lexer.hpp"
 #include "ast.hpp"
 
@@ -14,6 +13,7 @@ public:
 private:
     const std::vector<Token>& tokens;
     size_t pos = 0;
+    AstArena* arena = nullptr;
 
     // Helpers
     const Token& peek(int off = 0) const;
@@ -23,13 +23,16 @@ private:
 
     // Declarations
     DeclPtr parseDecl();
-    std::unique_ptr<FuncDecl> parseFunc();
+    FuncDecl* parseFunc();
+    TableDecl* parseTable();
+    FieldDecl* parseField();
 
     // Statements
     StmtPtr parseStmt();
-    std::unique_ptr<ReturnStmt> parseReturn();
+    ReturnStmt* parseReturn();
+    RepeatStmt* parseRepeat();
     StmtPtr parseAssignStmt();
-    std::vector<StmtPtr> parseBlock();
+    AstList<Stmt> parseBlock();
 
     // Expressions
     ExprPtr parseIndentiferFamily(ExprPtr identifier);
@@ -37,6 +40,10 @@ private:
     ExprPtr parsePrimitive();
     ExprPtr parseCallExpr(ExprPtr identifier);
 
+    // Literals
+    int intLiteral(const Token& tok, const char* what);
+    DataExpr* parseData();
+
     // Utils
     bool isBinaryOp(const std::string& op) const;
 };
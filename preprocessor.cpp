@@ -3,11 +3,25 @@
 #include <string>
 #include <cctype>
 #include <stdexcept>
+#include <vector>
 
-std::string Preprocessor::process(const std::string &source) {
+static bool isWordChar(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+// Masks are stripped and every Mask.field reference is recorded in a single
+// scan of the source. Masks may be declared after their first use, so the
+// values are spliced in afterwards in one more linear pass over the output.
+std::string Preprocessor::process(std::string_view source) {
     std::unordered_map<std::string,std::string> masks;
+    struct FieldRef {
+        size_t pos;        // where the value goes in output
+        std::string key;
+    };
+    std::vector<FieldRef> refs;
     int runningSum = 0;
     std::string output;
+    output.reserve(source.size());
     size_t i = 0, n = source.size();
 
     while (i < n) {
@@ -23,14 +37,26 @@ std::string Preprocessor::process(const std::string &source) {
             continue;
         }
 
-        if (n-i >= 4 && source.compare(i,4,"mask")==0 && (i+4==n || !std::isalnum(source[i+4]))) {
-            size_t maskStart = i;
-            size_t maskLineStart = output.size();
+        if (isWordChar(c)) {
+            size_t wordStart = i;
+            while (i<n && isWordChar(source[i])) ++i;
+            if (i-wordStart != 4 || source.compare(wordStart,4,"mask") != 0) {
+                if (i+1<n && source[i]=='.' && isWordChar(source[i+1])) {
+                    size_t fieldStart = ++i;
+                    while (i<n && isWordChar(source[i])) ++i;
+                    refs.push_back({output.size(),
+                                    std::string(source.substr(wordStart,fieldStart-1-wordStart)) + "." +
+                                    std::string(source.substr(fieldStart,i-fieldStart))});
+                } else {
+                    output.append(source,wordStart,i-wordStart);
+                }
+                continue;
+            }
 
-            i +=4; while (i<n && std::isspace(source[i])) ++i;
+            while (i<n && std::isspace(source[i])) ++i;
             size_t nameStart = i;
             while (i<n && (std::isalnum(source[i]) || source[i]=='_')) ++i;
-            std::string maskName = source.substr(nameStart,i-nameStart);
+            std::string maskName(source.substr(nameStart,i-nameStart));
             while (i<n && source[i]!='{') ++i; if (i<n && source[i]=='{') ++i;
 
             while (i<n) {
@@ -50,7 +76,7 @@ std::string Preprocessor::process(const std::string &source) {
 
                 size_t fstart = i;
                 while (i<n && (std::isalnum(source[i]) || source[i]=='_')) ++i;
-                std::string field = source.substr(fstart,i-fstart);
+                std::string field(source.substr(fstart,i-fstart));
                 while (i<n && std::isspace(source[i])) {
                     if (source[i]=='\n') output.push_back('\n');
                     ++i;
@@ -62,7 +88,7 @@ std::string Preprocessor::process(const std::string &source) {
                 }
                 size_t numStart = i;
                 while (i<n && std::isdigit(source[i])) ++i;
-                std::string number = source.substr(numStart,i-numStart);
+                std::string number(source.substr(numStart,i-numStart));
                 int val = number.empty()?0:std::stoi(number);
 
                 if (field != "any") {
@@ -96,42 +122,29 @@ std::string Preprocessor::process(const std::string &source) {
             continue;
         }
 
+        if (c == '.') {
+            size_t start = output.size();
+            while (start>0 && std::isalnum(static_cast<unsigned char>(output[start-1]))) --start;
+            std::string before = output.substr(start);
+            if (!refs.empty() && refs.back().pos == output.size()) before = refs.back().key + before;
+            size_t end = i+1;
+            while (end<n && std::isalnum(static_cast<unsigned char>(source[end]))) ++end;
+            throw std::runtime_error("Unknown mask field "+before+std::string(source.substr(i,end-i)));
+        }
+
         output.push_back(source[i++]);
     }
 
-	bool changed = true;
-	while (changed) {
-	    changed = false;
-	    for (auto &kv : masks) {
-	        const std::string &key = kv.first;
-	        const std::string &val = kv.second;
-	        size_t pos = 0;
-	        while ((pos = output.find(key, pos)) != std::string::npos) {
-	            bool okBefore = (pos == 0) || !(std::isalnum(output[pos - 1]) || output[pos - 1] == '_');
-	            size_t afterPos = pos + key.size();
-	            bool okAfter = (afterPos >= output.size()) || !(std::isalnum(output[afterPos]) || output[afterPos] == '_');
-	            if (okBefore && okAfter) {
-	                output.replace(pos, key.size(), val);
-	                pos += val.size();
-	                changed = true;
-	            } else {
-	                pos += key.size();
-	            }
-	        }
-	    }
-	}
-
-    size_t dotPos=0;
-    while((dotPos = output.find('.',dotPos)) != std::string::npos) {
-        size_t start = dotPos;
-        while(start>0 && std::isalnum(output[start-1])) --start;
-        size_t end = dotPos+1;
-        while(end<output.size() && std::isalnum(output[end])) ++end;
-        std::string key = output.substr(start,end-start);
-        if(masks.find(key)==masks.end())
-            throw std::runtime_error("Unknown mask field "+key);
-        dotPos = end;
+    std::string resolved;
+    resolved.reserve(output.size() + refs.size() * 8);
+    size_t copied = 0;
+    for (auto &ref : refs) {
+        auto it = masks.find(ref.key);
+        if (it == masks.end()) throw std::runtime_error("Unknown mask field "+ref.key);
+        resolved.append(output,copied,ref.pos-copied);
+        resolved += it->second;
+        copied = ref.pos;
     }
-
-    return output;
+    resolved.append(output,copied,std::string::npos);
+    return resolved;
 }
@@ -1,7 +1,8 @@
 #pragma once
 #include <string>
+#include <string_view>
 
 class Preprocessor {
 public:
-    static std::string process(const std::string &src);
+    static std::string process(std::string_view src);
 };
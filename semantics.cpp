@@ -1,38 +1,235 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <iostream>
+#include <mutex>
 #include <stdexcept>
+#include <thread>
 #include "semantics.hpp"
 
-std::unordered_map<std::string, std::vector<int>> varMapping;
-std::unordered_map<std::string, FuncDecl*> funcMapping;
-std::unordered_map<int, Bit> bitMapping;
-int nextBitIndex = 0;
+static int newBit(CompilationContext& cx, Op op, int lhs = -1, int rhs = -1) {
+    cx.bitMapping.push_back(Bit{lhs, rhs, op});
+    return static_cast<int>(cx.bitMapping.size()) - 1;
+}
+
+// Returns the index of an existing gate with the same operator and operands,
+// or allocates a new one. &, | and ^ are keyed on (op, min, max) so a ^ b and
+// b ^ a share a gate; the node keeps the operand order it was first built with.
+static int makeGate(CompilationContext& cx, Op op, int lhs, int rhs = -1) {
+    bool commutative = op != Op::Not;
+    GateKey key{op,
+                commutative ? std::min(lhs, rhs) : lhs,
+                commutative ? std::max(lhs, rhs) : rhs};
+    ++cx.gateStats.requested;
+    auto it = cx.gateTable.find(key);
+    if (it != cx.gateTable.end()) {
+        ++cx.gateStats.reused;
+        return it->second;
+    }
+    int ni = newBit(cx, op, lhs, rhs);
+    cx.gateTable.emplace(key, ni);
+    return ni;
+}
+
+static int folded(CompilationContext& cx, int bit) {
+    ++cx.gateStats.folded;
+    return bit;
+}
+
+// The constant folding every gate request goes through, whether it comes
+// from an expression or from instantiating a function summary.
+static int foldGate(CompilationContext& cx, Op op, int li, int ri) {
+    switch (op) {
+        case Op::And:
+            if (li == 0 || ri == 0) return folded(cx, 0);
+            if (li == 1 && ri == 1) return folded(cx, 1);
+            if (li == 1) return folded(cx, ri);
+            if (ri == 1) return folded(cx, li);
+            return makeGate(cx, Op::And, li, ri);
+        case Op::Or:
+            if (li == 1 || ri == 1) return folded(cx, 1);
+            if (li == 0 && ri == 0) return folded(cx, 0);
+            if (li == 0) return folded(cx, ri);
+            if (ri == 0) return folded(cx, li);
+            return makeGate(cx, Op::Or, li, ri);
+        case Op::Xor:
+            if (li == ri) return folded(cx, 0);
+            if ((li == 0 && ri == 1) || (li == 1 && ri == 0)) return folded(cx, 1);
+            return makeGate(cx, Op::Xor, li, ri);
+        case Op::Not:
+            if (li == 0 || li == 1) return folded(cx, 1 - li);
+            return makeGate(cx, Op::Not, li);
+        default:
+            throw std::runtime_error("Invalid gate operator");
+    }
+}
+
+static int notBit(CompilationContext& cx, int a) {
+    if (a >= 2 && cx.bitMapping[a].op == Op::Not) return folded(cx, cx.bitMapping[a].lhs);
+    return foldGate(cx, Op::Not, a, -1);
+}
+
+static int xorBit(CompilationContext& cx, int a, int b) {
+    if (a == 0) return folded(cx, b);
+    if (b == 0) return folded(cx, a);
+    if (a == 1) return notBit(cx, b);
+    if (b == 1) return notBit(cx, a);
+    return foldGate(cx, Op::Xor, a, b);
+}
+
+// a + b, or a - b as a + ~b + 1, modulo 2^n for the wider width n. Operands
+// are MSB-first and the narrower one is zero-extended, so the low-order bits
+// line up. Each full adder spends a single AND: the carry out of a + b + c is
+// ((a ^ c) & (b ^ c)) ^ c. The adder is recorded in wordOps.
+static std::vector<int> addBits(CompilationContext& cx, const std::vector<int>& L, const std::vector<int>& R,
+                                bool subtract) {
+    size_t n = std::max(L.size(), R.size());
+    WordOp op{subtract ? WordOpKind::Sub : WordOpKind::Add, {}, {}, std::vector<int>(n)};
+    for (size_t i = 0; i < n; ++i) {
+        op.lhs.push_back(i + L.size() < n ? 0 : L[i + L.size() - n]);
+        op.rhs.push_back(i + R.size() < n ? 0 : R[i + R.size() - n]);
+    }
+
+    int carry = subtract ? 1 : 0;
+    for (size_t k = n; k-- > 0;) {
+        int a = op.lhs[k];
+        int b = subtract ? notBit(cx, op.rhs[k]) : op.rhs[k];
+        int x = xorBit(cx, a, carry);
+        op.sum[k] = xorBit(cx, x, b);
+        if (k > 0) carry = xorBit(cx, foldGate(cx, Op::And, x, xorBit(cx, b, carry)), carry);
+    }
+
+    if (n > 1) cx.wordOps.push_back(op);
+    return op.sum;
+}
+
+// Output columns of a table as circuits over the index bits. A sub-table is
+// split on its first index bit into a multiplexer, or a single AND, OR or XOR
+// when one half is constant or the complement of the other. Equal
+// sub-functions, across columns too, are built once, and the complement of
+// one already built costs an inverter.
+class TableCircuit {
+public:
+    TableCircuit(CompilationContext& cx, const std::vector<int>& index) : cx(cx), index(index) {}
+
+    // tt holds one '0' or '1' per value of the index bits from depth on.
+    int build(const std::string& tt, size_t depth) {
+        if (tt.find('1') == std::string::npos) return 0;
+        if (tt.find('0') == std::string::npos) return 1;
+        auto it = memo.find(tt);
+        if (it != memo.end()) return it->second;
+        std::string inverse = complement(tt);
+        it = memo.find(inverse);
+        if (it != memo.end()) return memo[tt] = notBit(cx, it->second);
+
+        size_t half = tt.size() / 2;
+        std::string f0 = tt.substr(0, half), f1 = tt.substr(half);
+        int x = index[depth];
+        int r;
+        if (f0 == f1) r = build(f0, depth + 1);
+        else if (f0.find('1') == std::string::npos) r = foldGate(cx, Op::And, x, build(f1, depth + 1));
+        else if (f1.find('1') == std::string::npos) r = foldGate(cx, Op::And, notBit(cx, x), build(f0, depth + 1));
+        else if (f0.find('0') == std::string::npos) r = foldGate(cx, Op::Or, notBit(cx, x), build(f1, depth + 1));
+        else if (f1.find('0') == std::string::npos) r = foldGate(cx, Op::Or, x, build(f0, depth + 1));
+        else if (f1 == complement(f0)) r = xorBit(cx, x, build(f0, depth + 1));
+        else {
+            int g0 = build(f0, depth + 1);
+            int g1 = build(f1, depth + 1);
+            r = xorBit(cx, g0, foldGate(cx, Op::And, x, xorBit(cx, g0, g1)));
+        }
+        return memo[tt] = r;
+    }
+
+private:
+    CompilationContext& cx;
+    const std::vector<int>& index;
+    std::unordered_map<std::string, int> memo;
+
+    static std::string complement(std::string tt) {
+        for (char& c : tt) c = c == '0' ? '1' : '0';
+        return tt;
+    }
+};
 
-void printDebug() {
+// Looks name up in the variables visible at the given summary depth. A miss
+// inside a summary body pulls the variable in from the enclosing scope as
+// fresh symbols and records it as a free variable of that summary.
+static std::vector<int>* findVar(CompilationContext& cx, size_t depth, const std::string& name) {
+    auto& vars = depth == cx.summaryFrames.size() ? cx.varMapping : cx.summaryFrames[depth].callerVars;
+    auto it = vars.find(name);
+    if (it != vars.end()) return &it->second;
+    if (depth == 0) return nullptr;
+
+    SummaryFrame& frame = cx.summaryFrames[depth - 1];
+    std::vector<int>* outer = findVar(cx, depth - 1, name);
+    if (!outer) {
+        frame.freeVars.push_back({name, -1});
+        return nullptr;
+    }
+    std::vector<int> symbols(outer->size());
+    for (int& sym : symbols) sym = cx.nextSymbol--;
+    frame.freeVars.push_back({name, static_cast<int>(symbols.size())});
+    frame.freeSymbols.insert(frame.freeSymbols.end(), symbols.begin(), symbols.end());
+    return &(vars[name] = std::move(symbols));
+}
+
+static std::vector<int>* findVar(CompilationContext& cx, const std::string& name) {
+    return findVar(cx, cx.summaryFrames.size(), name);
+}
+
+// Slice and index containers that do not exist yet are created empty.
+static std::vector<int>& containerVar(CompilationContext& cx, const std::string& name) {
+    if (std::vector<int>* v = findVar(cx, name)) return *v;
+    return cx.varMapping[name];
+}
+
+// Drops every node from mark onwards along with its gateTable entry.
+static void discardNodes(CompilationContext& cx, int mark) {
+    for (int i = static_cast<int>(cx.bitMapping.size()) - 1; i >= mark; --i) {
+        const Bit& b = cx.bitMapping[i];
+        if (!isGate(b.op)) continue;
+        bool commutative = b.op != Op::Not;
+        GateKey key{b.op,
+                    commutative ? std::min(b.lhs, b.rhs) : b.lhs,
+                    commutative ? std::max(b.lhs, b.rhs) : b.rhs};
+        auto it = cx.gateTable.find(key);
+        if (it != cx.gateTable.end() && it->second == i) cx.gateTable.erase(it);
+    }
+    cx.bitMapping.resize(mark);
+}
+
+void printDebug(const CompilationContext& cx) {
 
     std::cout << "=== varMapping ===\n";
-    for (auto &p : varMapping) {
+    for (auto &p : cx.varMapping) {
         std::cout << p.first << " : ";
         for(auto x : p.second){
             std::cout << std::to_string(x) << " ";
         }
     }
 
+    std::cout << "\n=== gates ===\n";
+    std::cout << "requested : " << cx.gateStats.requested << "\n";
+    std::cout << "reused    : " << cx.gateStats.reused << "\n";
+    std::cout << "folded    : " << cx.gateStats.folded << "\n";
+    std::cout << "dedup rate: " << cx.gateStats.dedupRate() * 100.0 << "%\n";
+
     std::cout << "=== bitMapping ===\n";
-    for (auto &p : bitMapping) {
-        int i = p.first;
-        Bit &b = p.second;
+    for (size_t i = 0; i < cx.bitMapping.size(); ++i) {
+        const Bit &b = cx.bitMapping[i];
         std::cout << i << " : ";
-        if (b.op.empty() && b.lhs == -1 && b.rhs == -1) {
-            std::cout << (b.value ? "1" : "0");
-        } else if (!b.op.empty() && b.op == "~") {
-            std::cout << "~ " << b.lhs;
-        } else if (!b.op.empty()) {
-            std::cout << b.lhs << " " << b.op << " " << b.rhs;
-        } else {
-            std::cout << "unknown";
+        switch (b.op) {
+            case Op::Const0: std::cout << "0"; break;
+            case Op::Const1: std::cout << "1"; break;
+            case Op::Input:  std::cout << "input " << (i - 2); break;
+            case Op::Undef:  std::cout << "unknown"; break;
+            case Op::Not:    std::cout << "~ " << b.lhs; break;
+            default:         std::cout << b.lhs << " " << opSymbol(b.op) << " " << b.rhs; break;
         }
         std::cout << "\n";
     }
@@ -41,17 +238,22 @@ void printDebug() {
 std::vector<int> SemanticAnalyzer::processPrimitive(Expr* expr) {
     std::vector<int> indices;
 
-    if (auto ve = dynamic_cast<VarExpr*>(expr)) {
-        auto it = varMapping.find(ve->name);
-        if (it == varMapping.end()) throw std::runtime_error("Unknown variable: " + ve->name);
-        indices =  it->second;
+    switch (expr->kind) {
+    case ExprKind::Var: {
+        auto ve = static_cast<VarExpr*>(expr);
+        std::vector<int>* bits = findVar(cx, ve->name);
+        if (!bits) throw std::runtime_error("Unknown variable: " + ve->name);
+        indices = *bits;
+        break;
     }
 
-    else if (auto se = dynamic_cast<SliceExpr*>(expr)) {
-        if (auto cvar = dynamic_cast<VarExpr*>(se->container.get())) {
-            auto &parent = varMapping[cvar->name];
-            int start = std::stoi(se->start.substr(4, se->start.size() - 5));
-            int end = (se->end == "-1") ? static_cast<int>(parent.size()) : std::stoi(se->end.substr(4, se->end.size() - 5));
+    case ExprKind::Slice: {
+        auto se = static_cast<SliceExpr*>(expr);
+        if (se->container->kind == ExprKind::Var) {
+            auto cvar = static_cast<VarExpr*>(se->container);
+            auto &parent = containerVar(cx, cvar->name);
+            int start = se->start;
+            int end = se->end;
             if (start < 0) start = static_cast<int>(parent.size()) + start;
             if (end < 0) end = static_cast<int>(parent.size()) + end;
             
@@ -60,132 +262,62 @@ std::vector<int> SemanticAnalyzer::processPrimitive(Expr* expr) {
             for (int i = start; i < end; ++i) indices.push_back(parent[i]);
         }
         else throw std::runtime_error("Slice container is not a variable");
+        break;
     }
 
-    else if (auto de = dynamic_cast<DataExpr*>(expr)) {
-        std::string s = de->value;
-
-        if (s.substr(0, 4) == "hex(" && s.back() == ')') {
-            s = s.substr(4, s.size() - 5);
-            unsigned long long val = std::stoull(s, nullptr, 16);
-            
-            int bitsNeeded = s.size() * 4;  
-
-            for (int i = bitsNeeded - 1; i >= 0; --i) {
-                int value = (val & (1ULL << i)) != 0 ? 1 : 0;
-                indices.push_back(value);
-            }
-        }
-
-        if (s.substr(0, 4) == "bit(" && s.back() == ')') {
-            std::string bits = s.substr(4, s.size() - 5);
-            for (char c : bits) {
-
-                int value = (c=='0') ? 0 : 1;
-                indices.push_back(value);
-            }
-        }
+    case ExprKind::Data: {
+        const BitLiteral& bits = static_cast<DataExpr*>(expr)->bits;
+        indices.reserve(bits.width);
+        for (int i = 0; i < bits.width; ++i) indices.push_back(bits.bit(i));
+        break;
     }
 
-    else if (auto ie = dynamic_cast<IndexExpr*>(expr)) {
-        if (auto cvar = dynamic_cast<VarExpr*>(ie->container.get())) {
-            auto &parent = varMapping[cvar->name];
-            int idx = std::stoi(ie->index.substr(4, ie->index.size() - 5));
+    case ExprKind::Index: {
+        auto ie = static_cast<IndexExpr*>(expr);
+        if (ie->container->kind == ExprKind::Var) {
+            auto cvar = static_cast<VarExpr*>(ie->container);
+            auto &parent = containerVar(cx, cvar->name);
+            int idx = ie->index;
             if (idx < 0) idx = static_cast<int>(parent.size()) + idx;
             if (idx < 0 || idx >= static_cast<int>(parent.size())) throw std::runtime_error("Invalid index");
             indices.push_back(parent[idx]);
         }
         else throw std::runtime_error("Index container is not a variable");
+        break;
     }
 
-    else if (auto ce = dynamic_cast<ConcatExpr*>(expr)) {
-        for (auto &op : ce->operands) {
-            auto sub = processPrimitive(op.get());
+    case ExprKind::Concat:
+        for (Expr* op : static_cast<ConcatExpr*>(expr)->operands) {
+            auto sub = processPrimitive(op);
             indices.insert(indices.end(), sub.begin(), sub.end());
         }
-    }
+        break;
 
-    else if (auto be = dynamic_cast<BinaryExpr*>(expr)) {
-        auto L = processPrimitive(be->lhs.get());
+    case ExprKind::Binary: {
+        auto be = static_cast<BinaryExpr*>(expr);
+        auto L = processPrimitive(be->lhs);
 
         if (be->op == "^" || be->op == "&" || be->op == "|") {
-            auto R = processPrimitive(be->rhs.get());
+            auto R = processPrimitive(be->rhs);
             size_t n = std::max(L.size(), R.size());
             for (size_t i = 0; i < n; ++i) {
                 int li = (i < L.size()) ? L[i] : 0;
                 int ri = (i < R.size()) ? R[i] : 0;
-
-
-                Bit nb;
-                nb.value = false;
-                nb.lhs = li;
-                nb.rhs = ri;
-                nb.op = be->op;
-                std::string op = be -> op;
-
-
-                if(be->op == "&"){
-                    if(li == 0 || ri == 0){
-                        indices.push_back(0);
-                    }
-                    else if(li == 1 && ri == 1){
-                        indices.push_back(1);
-                    }
-                    else if(li == 1){
-                        indices.push_back(ri);
-                    }
-                    else if(ri == 1){ 
-                        indices.push_back(li);
-                    }
-                    else{      
-                        int ni = nextBitIndex++;
-                        bitMapping[ni] = nb;
-                        indices.push_back(ni);
-                    }
-                }
-                if(be->op == "|"){
-                    
-                    if(li == 1 || ri == 1){
-                        indices.push_back(1);
-                    }
-                    else if(li == 0 && ri == 0){
-                        indices.push_back(0);
-                    }
-                    else if(li == 0){
-                        indices.push_back(ri);
-                    }
-                    else if(ri == 0){
-                        
-                        indices.push_back(li);
-                    }
-                    else{ 
-                        int ni = nextBitIndex++;
-                        bitMapping[ni] = nb;
-                        indices.push_back(ni);
-                    }
-                }
-                if(be->op == "^"){
-
-                    if(li == ri){
-                        indices.push_back(0);
-                    }
-                    else if(((li == 0 && ri ==1 ) || (li == 1 && ri == 0) ) && li != ri){
-                        indices.push_back(1);
-                    }
-                    else{
-                        int ni = nextBitIndex++;
-                        bitMapping[ni] = nb;
-                        indices.push_back(ni);
-                    }
-                }
-
+                Op op = be->op == "&" ? Op::And : be->op == "|" ? Op::Or : Op::Xor;
+                indices.push_back(foldGate(cx, op, li, ri));
             }
 
         }
 
-        else if (auto rhsVar = dynamic_cast<DataExpr*>(be->rhs.get())) {
-            if (rhsVar->value.rfind("bit(", 0) == 0 && rhsVar->value.back() == ')') {
-                int num = std::stoi(rhsVar->value.substr(4, rhsVar->value.size() - 5));
+        else if (be->op == "+" || be->op == "-") {
+            indices = addBits(cx, L, processPrimitive(be->rhs), be->op == "-");
+        }
+
+        else if (be->rhs->kind == ExprKind::Data) {
+            auto rhsVar = static_cast<DataExpr*>(be->rhs);
+            if (rhsVar->decimal) {
+                int num = rhsVar->amount;
+                if (num < 0) throw std::runtime_error("Shift amount out of range");
 
                 if (be->op == ">>") {
                     if (num > 0 && num < (int)L.size()) {
@@ -226,153 +358,1007 @@ std::vector<int> SemanticAnalyzer::processPrimitive(Expr* expr) {
 
             indices = L;
         }
+        break;
+    }
+
+    case ExprKind::Not: {
+        auto S = processPrimitive(static_cast<NotExpr*>(expr)->expr);
+        for (int sidx : S) indices.push_back(foldGate(cx, Op::Not, sidx, -1));
+        break;
     }
 
+    case ExprKind::Call: {
+        auto ce = static_cast<CallExpr*>(expr);
+        if (ce->callee->kind == ExprKind::Var) {
+            auto calleeVar = static_cast<VarExpr*>(ce->callee);
+            auto gfit = cx.fieldMapping.find(calleeVar->name);
+            if (gfit != cx.fieldMapping.end()) {
+                if (!ce->arg2) throw std::runtime_error("Field " + calleeVar->name + " takes two arguments");
+                return multiplyField(*gfit->second, processPrimitive(ce->arg), processPrimitive(ce->arg2));
+            }
+            if (ce->arg2) throw std::runtime_error(calleeVar->name + " takes one argument");
+            auto tit = cx.tableMapping.find(calleeVar->name);
+            if (tit != cx.tableMapping.end()) return lookupTable(*tit->second, processPrimitive(ce->arg));
+            auto fit = cx.funcMapping.find(calleeVar->name);
+            if (fit == cx.funcMapping.end()) throw std::runtime_error("Unknown function: " + calleeVar->name);
+            std::vector<int> arg = processPrimitive(ce->arg);
+            return callFunction(*(fit->second), arg);
+        }
+        else throw std::runtime_error("Call target is not a simple var");
+    }
+    }
+
+    return indices;
+}
+
+std::vector<int> SemanticAnalyzer::processFunction(FuncDecl& function, std::vector<int>& inputIndices) {
+    cx.varMapping[function.name] = inputIndices;
+    std::vector<int> result;
+    processBlock(function.body, result);
+    return result;
+}
+
+// Runs statements in order. Returns true, with the value in result, once a
+// return statement is reached. With more than one analysis thread, runs of
+// statements that can go to worker threads are handed to processLanes.
+bool SemanticAnalyzer::processBlock(const AstList<Stmt>& body, std::vector<int>& result) {
+    unsigned threads = cx.analysisThreads ? cx.analysisThreads : std::thread::hardware_concurrency();
+    for (size_t k = 0; k < body.size();) {
+        size_t end = threads > 1 ? processLanes(body, k, threads) : k;
+        if (end > k) {
+            k = end;
+            continue;
+        }
+        if (processStmt(body[k++], result)) return true;
+    }
+    return false;
+}
+
+// Runs one statement. Returns true, with the value in result, if it is a
+// return statement.
+bool SemanticAnalyzer::processStmt(Stmt* stmt, std::vector<int>& result) {
+    switch (stmt->kind) {
+    case StmtKind::Assign: {
+        auto asgn = static_cast<AssignStmt*>(stmt);
+        Expr* lhs = asgn->lhs;
+        std::vector<int> rhsIndices = processPrimitive(asgn->rhs);
+
+        if (lhs->kind == ExprKind::Var) {
+            cx.varMapping[static_cast<VarExpr*>(lhs)->name] = rhsIndices;
+            return false;
+        }
 
-    else if (auto ne = dynamic_cast<NotExpr*>(expr)) {
-        auto S = processPrimitive(ne->expr.get());
-        for (int sidx : S) {
-            Bit nb;
-            nb.value = false;
-            nb.lhs = sidx;
-            nb.rhs = -1;
-            nb.op = "~";
-            if(nb.lhs == 0 || nb.lhs == 1){
-                indices.push_back((nb.lhs+1) % 2);
+        if (lhs->kind == ExprKind::Slice) {
+            auto lhsSlice = static_cast<SliceExpr*>(lhs);
+            if (lhsSlice->container->kind == ExprKind::Var) {
+                auto cvar = static_cast<VarExpr*>(lhsSlice->container);
+                auto &parent = containerVar(cx, cvar->name);
+                int start = lhsSlice->start;
+                int end = lhsSlice->end;
+                if (start < 0) start = static_cast<int>(parent.size()) + start;
+                if (end < 0) end = static_cast<int>(parent.size()) + end;
+                if (start < 0 || end < start || end > static_cast<int>(parent.size())) throw std::runtime_error("Invalid slice indices");
+                for (int i = start; i < end; ++i) {
+                    int src = (i - start < static_cast<int>(rhsIndices.size())) ? rhsIndices[i - start] : -1;
+                    if (src != -1) parent[i] = src;
+                    else parent[i] = newBit(cx, Op::Undef);
+                }
+                cx.varMapping[cvar->name] = parent;
+                return false;
             }
-            else {
-                int ni = nextBitIndex++;
-                bitMapping[ni] = nb;
-                indices.push_back(ni);
+            else throw std::runtime_error("Slice target container not a variable");
+        }
+
+        if (lhs->kind == ExprKind::Index) {
+            auto lhsIndex = static_cast<IndexExpr*>(lhs);
+            if (lhsIndex->container->kind == ExprKind::Var) {
+                auto cvar = static_cast<VarExpr*>(lhsIndex->container);
+                auto &parent = containerVar(cx, cvar->name);
+                int idx = lhsIndex->index;
+                if (idx < 0) idx = static_cast<int>(parent.size()) + idx;
+                if (idx < 0 || idx >= static_cast<int>(parent.size())) throw std::runtime_error("Invalid index on LHS");
+                int src = (rhsIndices.empty() ? -1 : rhsIndices[0]);
+                if (src != -1) parent[idx] = src;
+                else parent[idx] = newBit(cx, Op::Undef);
+                cx.varMapping[cvar->name] = parent;
+                return false;
             }
+            else throw std::runtime_error("Index target container not a variable");
         }
+
+        throw std::runtime_error("Unsupported LHS in assignment");
+    }
+
+    case StmtKind::Repeat:
+        processRepeat(*static_cast<RepeatStmt*>(stmt));
+        break;
+
+    case StmtKind::Return:
+        result = processPrimitive(static_cast<ReturnStmt*>(stmt)->value);
+        return true;
+    }
+    return false;
+}
+
+static bool summaryApplies(CompilationContext& cx, const FunctionSummary& summary, int argWidth) {
+    if (summary.argWidth != argWidth) return false;
+    for (auto& fv : summary.freeVars) {
+        std::vector<int>* v = findVar(cx, fv.first);
+        int width = v ? static_cast<int>(v->size()) : -1;
+        if (width != fv.second) return false;
+    }
+    return true;
+}
+
+// Runs body against argWidth fresh symbols in an empty varMapping and turns
+// the nodes it added into a FunctionSummary, leaving bitMapping, gateTable
+// and gateStats as they were.
+static FunctionSummary summarizeBody(CompilationContext& cx, int argWidth,
+                                     const std::function<std::vector<int>(std::vector<int>&)>& body) {
+    int mark = static_cast<int>(cx.bitMapping.size());
+    size_t opMark = cx.wordOps.size();
+    size_t tableMark = cx.tableOps.size();
+    size_t fieldMark = cx.fieldOps.size();
+    GateStats savedStats = cx.gateStats;
+    std::vector<int> params(argWidth);
+    for (int& sym : params) sym = cx.nextSymbol--;
+
+    cx.summaryFrames.push_back(SummaryFrame{std::move(cx.varMapping), {}, {}});
+    cx.varMapping.clear();
+    auto restore = [&]() -> SummaryFrame {
+        SummaryFrame frame = std::move(cx.summaryFrames.back());
+        cx.summaryFrames.pop_back();
+        cx.varMapping = std::move(frame.callerVars);
+        return frame;
+    };
+
+    std::vector<int> ret;
+    try {
+        ret = body(params);
+    } catch (...) {
+        restore();
+        discardNodes(cx, mark);
+        cx.wordOps.resize(opMark);
+        cx.tableOps.resize(tableMark);
+        cx.fieldOps.resize(fieldMark);
+        cx.gateStats = savedStats;
+        throw;
     }
+    std::unordered_map<std::string, std::vector<int>> bodyVars = std::move(cx.varMapping);
+    SummaryFrame frame = restore();
 
-    else if (auto ce = dynamic_cast<CallExpr*>(expr)) {
-        if (auto calleeVar = dynamic_cast<VarExpr*>(ce->callee.get())) {
-            auto fit = funcMapping.find(calleeVar->name);
-            if (fit == funcMapping.end()) throw std::runtime_error("Unknown function: " + calleeVar->name);
-            std::vector<int> arg = processPrimitive(ce->arg.get());
-            return processFunction(*(fit->second), arg);
+    std::unordered_map<int, int> symbolIndex;
+    for (int sym : params) symbolIndex.emplace(sym, static_cast<int>(symbolIndex.size()));
+    for (int sym : frame.freeSymbols) symbolIndex.emplace(sym, static_cast<int>(symbolIndex.size()));
+    auto encode = [&](int idx) {
+        if (idx == 0 || idx == 1) return idx;
+        if (idx >= mark) return idx - mark + 2;
+        auto it = symbolIndex.find(idx);
+        if (it == symbolIndex.end()) throw std::runtime_error("Function summary refers to an outside bit");
+        return -(it->second + 1);
+    };
+    auto encodeAll = [&](const std::vector<int>& bits) {
+        std::vector<int> enc;
+        enc.reserve(bits.size());
+        for (int b : bits) enc.push_back(encode(b));
+        return enc;
+    };
+
+    FunctionSummary summary;
+    summary.argWidth = argWidth;
+    try {
+        summary.freeVars = frame.freeVars;
+        for (int i = mark; i < static_cast<int>(cx.bitMapping.size()); ++i) {
+            Bit b = cx.bitMapping[i];
+            if (isGate(b.op)) {
+                b.lhs = encode(b.lhs);
+                if (b.op != Op::Not) b.rhs = encode(b.rhs);
+            }
+            summary.nodes.push_back(b);
         }
-        else throw std::runtime_error("Call target is not a simple var");
+        summary.ret = encodeAll(ret);
+        // Sorted by name rather than in map order, which depends on the order
+        // the names were added and so on whether lanes built the body.
+        for (auto& v : bodyVars) summary.vars.push_back({v.first, encodeAll(v.second)});
+        std::sort(summary.vars.begin(), summary.vars.end(),
+                  [](const auto& a, const auto& b) { return a.first < b.first; });
+        for (size_t k = opMark; k < cx.wordOps.size(); ++k) {
+            const WordOp& op = cx.wordOps[k];
+            summary.wordOps.push_back(WordOp{op.kind, encodeAll(op.lhs), encodeAll(op.rhs), encodeAll(op.sum)});
+        }
+        for (size_t k = tableMark; k < cx.tableOps.size(); ++k) {
+            const TableOp& op = cx.tableOps[k];
+            summary.tableOps.push_back(TableOp{op.table, encodeAll(op.in), encodeAll(op.out)});
+        }
+        for (size_t k = fieldMark; k < cx.fieldOps.size(); ++k) {
+            const FieldOp& op = cx.fieldOps[k];
+            summary.fieldOps.push_back(FieldOp{op.field, encodeAll(op.lhs), encodeAll(op.rhs), encodeAll(op.out)});
+        }
+    } catch (...) {
+        discardNodes(cx, mark);
+        cx.wordOps.resize(opMark);
+        cx.tableOps.resize(tableMark);
+        cx.fieldOps.resize(fieldMark);
+        cx.gateStats = savedStats;
+        throw;
+    }
+    discardNodes(cx, mark);
+    cx.wordOps.resize(opMark);
+    cx.tableOps.resize(tableMark);
+    cx.fieldOps.resize(fieldMark);
+    cx.gateStats = savedStats;
+    return summary;
+}
+
+static bool sameShape(const FunctionSummary& a, const FunctionSummary& b) {
+    return a.argWidth == b.argWidth && a.freeVars == b.freeVars;
+}
+
+static void readVar(VarUse& use, const std::string& name) {
+    if (!use.writes.count(name)) use.reads.insert(name);
+}
+
+static void lookVar(VarUse& use, const std::string& name) {
+    if (!use.writes.count(name)) use.lookups.insert(name);
+}
+
+static void useOfStmt(CompilationContext& cx, const Stmt* stmt, VarUse& use);
+
+// What a function body reads and assigns up to its first return. The entry is
+// opaque while the body is walked, so a call back into the function makes
+// every caller on the cycle opaque.
+static const VarUse& functionUse(CompilationContext& cx, const FuncDecl& function) {
+    auto it = cx.varUse.find(&function);
+    if (it != cx.varUse.end()) return it->second;
+    cx.varUse[&function].opaque = true;
+    VarUse use;
+    use.writes.insert(function.name);
+    for (const Stmt* stmt : function.body) {
+        useOfStmt(cx, stmt, use);
+        if (stmt->kind == StmtKind::Return) break;
     }
-    else throw std::runtime_error("Invalid primitive");
+    return cx.varUse[&function] = std::move(use);
+}
 
-    for(int ind = 0; ind < indices.size(); ind++){
-        int v = indices[ind];
-        Bit b = bitMapping[v];
-        if((b.lhs == 0 || b.lhs == 1) && (b.rhs == -1) && (b.op == "")){
-            indices[ind] = b.lhs;
+static void useOfExpr(CompilationContext& cx, const Expr* expr, VarUse& use) {
+    auto container = [&](const Expr* c) {
+        if (c->kind == ExprKind::Var) readVar(use, static_cast<const VarExpr*>(c)->name);
+        else use.opaque = true;
+    };
+    switch (expr->kind) {
+    case ExprKind::Data:
+        break;
+    case ExprKind::Var:
+        readVar(use, static_cast<const VarExpr*>(expr)->name);
+        break;
+    case ExprKind::Index:
+        container(static_cast<const IndexExpr*>(expr)->container);
+        break;
+    case ExprKind::Slice:
+        container(static_cast<const SliceExpr*>(expr)->container);
+        break;
+    case ExprKind::Concat:
+        for (const Expr* op : static_cast<const ConcatExpr*>(expr)->operands) useOfExpr(cx, op, use);
+        break;
+    case ExprKind::Binary:
+        useOfExpr(cx, static_cast<const BinaryExpr*>(expr)->lhs, use);
+        useOfExpr(cx, static_cast<const BinaryExpr*>(expr)->rhs, use);
+        break;
+    case ExprKind::Not:
+        useOfExpr(cx, static_cast<const NotExpr*>(expr)->expr, use);
+        break;
+    case ExprKind::Call: {
+        auto ce = static_cast<const CallExpr*>(expr);
+        use.calls = true;
+        if (ce->callee->kind != ExprKind::Var) {
+            use.opaque = true;
+            break;
+        }
+        const std::string& name = static_cast<const VarExpr*>(ce->callee)->name;
+        if (cx.fieldMapping.count(name) != (ce->arg2 != nullptr)) {
+            use.opaque = true;
+            break;
+        }
+        if (ce->arg2) {
+            // The two operands may be evaluated in either order, so neither
+            // counts as assigning anything before the other reads it.
+            VarUse a, b;
+            useOfExpr(cx, ce->arg, a);
+            useOfExpr(cx, ce->arg2, b);
+            for (const VarUse* part : {&a, &b}) {
+                for (auto& r : part->reads) readVar(use, r);
+                for (auto& l : part->lookups) lookVar(use, l);
+                use.opaque = use.opaque || part->opaque;
+            }
+            use.writes.insert(a.writes.begin(), a.writes.end());
+            use.writes.insert(b.writes.begin(), b.writes.end());
+            break;
+        }
+        useOfExpr(cx, ce->arg, use);
+        if (cx.tableMapping.count(name)) break;
+        auto fit = cx.funcMapping.find(name);
+        if (fit == cx.funcMapping.end()) {
+            use.opaque = true;
+            break;
         }
+        const VarUse& callee = functionUse(cx, *fit->second);
+        for (auto& r : callee.reads) readVar(use, r);
+        for (auto& l : callee.lookups) lookVar(use, l);
+        use.writes.insert(callee.writes.begin(), callee.writes.end());
+        use.opaque = use.opaque || callee.opaque;
+        break;
+    }
     }
-    return indices;
 }
 
-std::vector<int> SemanticAnalyzer::processFunction(FuncDecl& function, std::vector<int>& inputIndices) {
-    varMapping[function.name] = inputIndices;
-    for (auto &stmt : function.body) {
-        if (auto asgn = dynamic_cast<AssignStmt*>(stmt.get())) {
-            Expr* lhs = asgn->lhs.get();
-            Expr* rhs = asgn->rhs.get();
-            std::vector<int> rhsIndices = processPrimitive(rhs);
-
-            if (auto lhsVar = dynamic_cast<VarExpr*>(lhs)) {
-                varMapping[lhsVar->name] = rhsIndices;
-                continue;
+static void useOfStmt(CompilationContext& cx, const Stmt* stmt, VarUse& use) {
+    switch (stmt->kind) {
+    case StmtKind::Assign: {
+        auto asgn = static_cast<const AssignStmt*>(stmt);
+        useOfExpr(cx, asgn->rhs, use);
+        const Expr* target = asgn->lhs;
+        if (target->kind == ExprKind::Slice) target = static_cast<const SliceExpr*>(target)->container;
+        else if (target->kind == ExprKind::Index) target = static_cast<const IndexExpr*>(target)->container;
+        if (target->kind != ExprKind::Var) {
+            use.opaque = true;
+            break;
+        }
+        const std::string& name = static_cast<const VarExpr*>(target)->name;
+        if (target != asgn->lhs) readVar(use, name);
+        use.writes.insert(name);
+        break;
+    }
+    case StmtKind::Return:
+        useOfExpr(cx, static_cast<const ReturnStmt*>(stmt)->value, use);
+        break;
+    case StmtKind::Repeat: {
+        auto loop = static_cast<const RepeatStmt*>(stmt);
+        if (loop->count <= 0) break;
+        VarUse body;
+        for (const Stmt* s : loop->body) {
+            if (s->kind == StmtKind::Return) body.opaque = true;
+            useOfStmt(cx, s, body);
+        }
+        // Before the first iteration processRepeat looks up every variable
+        // the body assigns, for the loop's entry state.
+        for (auto& r : body.reads) readVar(use, r);
+        for (auto& l : body.lookups) lookVar(use, l);
+        for (auto& w : body.writes) lookVar(use, w);
+        use.writes.insert(body.writes.begin(), body.writes.end());
+        use.calls = true;
+        use.opaque = use.opaque || body.opaque;
+        break;
+    }
+    }
+}
+
+namespace {
+
+struct LaneMark {
+    int nodes;
+    size_t wordOps, tableOps, fieldOps, loopRegions;
+};
+
+// Statements of one block that read nothing the other lanes assign, analyzed
+// in a context of their own. image maps each of its nodes into this graph.
+struct Lane {
+    std::vector<size_t> stmts;
+    VarUse use;
+    CompilationContext cx;
+    std::vector<int> image;
+    std::vector<LaneMark> marks;   // before each statement and after the last
+    bool failed = false;
+};
+
+LaneMark markOf(const CompilationContext& cx) {
+    return LaneMark{static_cast<int>(cx.bitMapping.size()), cx.wordOps.size(), cx.tableOps.size(),
+                    cx.fieldOps.size(), cx.loopRegions.size()};
+}
+
+}  // namespace
+
+// Worker threads that live as long as the analyzer, so a block with many
+// short runs of lanes does not start threads for every run.
+class LanePool {
+public:
+    explicit LanePool(unsigned workers) {
+        for (unsigned t = 0; t < workers; ++t) threads.emplace_back([this] { loop(); });
+    }
+    ~LanePool() {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            stop = true;
+        }
+        wake.notify_all();
+        for (std::thread& t : threads) t.join();
+    }
+    size_t size() const { return threads.size(); }
+
+    // Runs work on every worker and on the calling thread, and returns once
+    // all of them are done. work must not throw.
+    void run(const std::function<void()>& work) {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            job = &work;
+            busy = threads.size();
+            ++generation;
+        }
+        wake.notify_all();
+        work();
+        std::unique_lock<std::mutex> lock(m);
+        done.wait(lock, [&] { return busy == 0; });
+    }
+
+private:
+    void loop() {
+        size_t seen = 0;
+        for (;;) {
+            const std::function<void()>* task;
+            {
+                std::unique_lock<std::mutex> lock(m);
+                wake.wait(lock, [&] { return stop || generation != seen; });
+                if (stop) return;
+                seen = generation;
+                task = job;
             }
+            (*task)();
+            std::lock_guard<std::mutex> lock(m);
+            if (--busy == 0) done.notify_one();
+        }
+    }
 
-            if (auto lhsSlice = dynamic_cast<SliceExpr*>(lhs)) {
-                if (auto cvar = dynamic_cast<VarExpr*>(lhsSlice->container.get())) {
-                    auto &parent = varMapping[cvar->name];
-                    int start = std::stoi(lhsSlice->start.substr(4, lhsSlice->start.size() - 5));
-                    int end = (lhsSlice->end == "-1") ? static_cast<int>(parent.size()) : std::stoi(lhsSlice->end.substr(4, lhsSlice->end.size() - 5));
-                    if (start < 0) start = static_cast<int>(parent.size()) + start;
-                    if (end < 0) end = static_cast<int>(parent.size()) + end;
-                    if (start < 0 || end < start || end > static_cast<int>(parent.size())) throw std::runtime_error("Invalid slice indices");
-                    for (int i = start; i < end; ++i) {
-                        int src = (i - start < static_cast<int>(rhsIndices.size())) ? rhsIndices[i - start] : -1;
-                        if (src != -1) parent[i] = src;
-                        else {
-                            Bit nb; nb.op = ""; nb.lhs = nb.rhs = -1; nb.value = false;
-                            int ni = nextBitIndex++;
-                            bitMapping[ni] = nb;
-                            parent[i] = ni;
-                        }
-                    }
-                    varMapping[cvar->name] = parent;
-                    continue;
+    std::vector<std::thread> threads;
+    std::mutex m;
+    std::condition_variable wake, done;
+    const std::function<void()>* job = nullptr;
+    size_t generation = 0;
+    size_t busy = 0;
+    bool stop = false;
+};
+
+// Runs the statements from begin up to the next return, or the next one the
+// walk above cannot follow, on worker threads when they split into two or
+// more lanes that call something: no lane reads a variable another one
+// assigns before it. A lane runs in a context of its own whose variables
+// start as inputs standing in for the bits read here, and uses this context's
+// summaries without changing them. Then every statement's new nodes are
+// replayed here in statement order through gateTable. A lane's graph differs
+// from ours only where one of its gates is a gate we already had, so the
+// replay builds exactly what running the statements here would have, for
+// any thread count. If a lane throws, or a replayed gate turns out to be one
+// the lane already stands in for, the lanes are dropped and the statements
+// run here instead. Returns the end of the statements it ran, begin if none.
+size_t SemanticAnalyzer::processLanes(const AstList<Stmt>& body, size_t begin, unsigned threads) {
+    // A statement joins the lane of the last one to assign anything it reads.
+    // One that would join two lanes that call something ends the run, and
+    // statements that call nothing are cheap and share a single lane. A run
+    // starts with a call, so that cheap statements ahead of it, which the
+    // lanes would all read, stay here.
+    std::vector<VarUse> uses;
+    std::vector<size_t> root;
+    std::vector<char> calls;
+    auto find = [&](size_t i) {
+        while (root[i] != i) i = root[i] = root[root[i]];
+        return i;
+    };
+    std::unordered_map<std::string, size_t> lastWriter;
+    size_t end = begin;
+    for (; end < body.size() && body[end]->kind != StmtKind::Return; ++end) {
+        VarUse use;
+        useOfStmt(cx, body[end], use);
+        if (use.opaque || (end == begin && !use.calls)) break;
+        size_t i = end - begin;
+        std::vector<size_t> joined;
+        for (const auto* names : {&use.reads, &use.lookups})
+            for (auto& name : *names) {
+                auto it = lastWriter.find(name);
+                if (it != lastWriter.end()) joined.push_back(find(it->second));
+            }
+        std::sort(joined.begin(), joined.end());
+        joined.erase(std::unique(joined.begin(), joined.end()), joined.end());
+        if (std::count_if(joined.begin(), joined.end(), [&](size_t r) { return calls[r]; }) > 1) break;
+        root.push_back(i);
+        calls.push_back(use.calls);
+        for (size_t r : joined) {
+            root[r] = i;
+            calls[i] = calls[i] || calls[r];
+        }
+        for (auto& w : use.writes) lastWriter[w] = i;
+        uses.push_back(std::move(use));
+    }
+    size_t n = end - begin;
+    if (n < 2) return begin;
+    auto runHere = [&]() {
+        std::vector<int> unused;
+        for (size_t k = begin; k < end; ++k) processStmt(body[k], unused);
+        return end;
+    };
+
+    std::vector<int> laneOfRoot(n, -1);
+    std::vector<size_t> laneOf(n);
+    int cheap = -1;
+    size_t laneCount = 0, costly = 0;
+    for (size_t i = 0; i < n; ++i) {
+        size_t r = find(i);
+        int& lane = calls[r] ? laneOfRoot[r] : cheap;
+        if (lane < 0) {
+            lane = static_cast<int>(laneCount++);
+            if (calls[r]) ++costly;
+        }
+        laneOf[i] = lane;
+    }
+    if (costly < 2) return runHere();
+    std::vector<Lane> lanes(laneCount);
+    for (size_t i = 0; i < n; ++i) {
+        Lane& lane = lanes[laneOf[i]];
+        for (auto& name : uses[i].reads) readVar(lane.use, name);
+        for (auto& name : uses[i].lookups) lookVar(lane.use, name);
+        lane.use.writes.insert(uses[i].writes.begin(), uses[i].writes.end());
+        lane.stmts.push_back(i);
+    }
+
+    // Inside a summary a variable missing here would be looked up in the
+    // caller, which a lane cannot do.
+    bool summarizing = !cx.summaryFrames.empty();
+    for (Lane& lane : lanes) {
+        for (auto& r : lane.use.reads)
+            if (!cx.varMapping.count(r)) return runHere();
+        for (auto& l : lane.use.lookups)
+            if (summarizing && !cx.varMapping.count(l)) return runHere();
+    }
+
+    auto run = [&](Lane& lane) {
+        CompilationContext& w = lane.cx;
+        // A NOT is brought in as a NOT of its operand so that ~~x still folds
+        // to x; every other bit becomes an input.
+        std::unordered_map<int, int> local;
+        std::vector<int>& image = lane.image;
+        std::function<int(int)> import = [&](int g) {
+            if (g == 0 || g == 1) return g;
+            auto it = local.find(g);
+            if (it != local.end()) return it->second;
+            int l = g >= 2 && cx.bitMapping[g].op == Op::Not ? makeGate(w, Op::Not, import(cx.bitMapping[g].lhs))
+                                                              : newBit(w, Op::Input);
+            local.emplace(g, l);
+            image.resize(w.bitMapping.size(), -1);
+            image[l] = g;
+            return l;
+        };
+        try {
+            w.funcMapping = cx.funcMapping;
+            w.tableMapping = cx.tableMapping;
+            w.fieldMapping = cx.fieldMapping;
+            w.summariesInProgress = cx.summariesInProgress;
+            w.sharedSummaries = &cx.summaryCache;
+            w.analysisThreads = 1;
+            newBit(w, Op::Const0);
+            newBit(w, Op::Const1);
+            image = {0, 1};
+            for (const auto* names : {&lane.use.reads, &lane.use.lookups})
+                for (auto& name : *names) {
+                    auto it = cx.varMapping.find(name);
+                    if (it == cx.varMapping.end() || w.varMapping.count(name)) continue;
+                    std::vector<int>& bits = w.varMapping[name];
+                    for (int g : it->second) bits.push_back(import(g));
                 }
-                else throw std::runtime_error("Slice target container not a variable");
+            w.gateStats = GateStats{};
+
+            SemanticAnalyzer analyzer(w);
+            std::vector<int> unused;
+            for (size_t i : lane.stmts) {
+                lane.marks.push_back(markOf(w));
+                analyzer.processStmt(body[begin + i], unused);
             }
+            lane.marks.push_back(markOf(w));
+        } catch (...) {
+            lane.failed = true;
+        }
+    };
+    std::atomic<size_t> next{0};
+    std::function<void()> work = [&]() {
+        for (size_t k; (k = next.fetch_add(1)) < lanes.size();) run(lanes[k]);
+    };
+    if (!lanePool || lanePool->size() != threads - 1) {
+        lanePool.reset();
+        lanePool = std::make_unique<LanePool>(threads - 1);
+    }
+    lanePool->run(work);
 
-            if (auto lhsIndex = dynamic_cast<IndexExpr*>(lhs)) {
-                if (auto cvar = dynamic_cast<VarExpr*>(lhsIndex->container.get())) {
-                    auto &parent = varMapping[cvar->name];
-                    int idx = std::stoi(lhsIndex->index.substr(4, lhsIndex->index.size() - 5));
-                    if (idx < 0) idx = static_cast<int>(parent.size()) + idx;
-                    if (idx < 0 || idx >= static_cast<int>(parent.size())) throw std::runtime_error("Invalid index on LHS");
-                    int src = (rhsIndices.empty() ? -1 : rhsIndices[0]);
-                    if (src != -1) parent[idx] = src;
-                    else {
-                        Bit nb; nb.op = ""; nb.lhs = nb.rhs = -1; nb.value = false;
-                        int ni = nextBitIndex++;
-                        bitMapping[ni] = nb;
-                        parent[idx] = ni;
-                    }
-                    varMapping[cvar->name] = parent;
+    for (Lane& lane : lanes) if (lane.failed) return runHere();
+    for (auto& v : lastWriter)
+        if (!lanes[laneOf[v.second]].cx.varMapping.count(v.first)) return runHere();
+
+    int mark = static_cast<int>(cx.bitMapping.size());
+    size_t wordMark = cx.wordOps.size();
+    size_t tableMark = cx.tableOps.size();
+    size_t fieldMark = cx.fieldOps.size();
+    size_t loopMark = cx.loopRegions.size();
+    std::vector<std::vector<char>> fresh(lanes.size());
+    std::vector<std::unordered_set<int>> taken(lanes.size());
+    for (size_t l = 0; l < lanes.size(); ++l) {
+        Lane& lane = lanes[l];
+        for (size_t k = 2; k < lane.image.size(); ++k) taken[l].insert(lane.image[k]);
+        lane.image.resize(lane.cx.bitMapping.size(), -1);
+        fresh[l].assign(lane.image.size(), 0);
+    }
+
+    auto remap = [](const std::vector<int>& image, const std::vector<int>& bits) {
+        std::vector<int> out;
+        out.reserve(bits.size());
+        for (int b : bits) out.push_back(b < 0 ? b : image[b]);
+        return out;
+    };
+    std::vector<size_t> cursor(lanes.size(), 0);
+    std::vector<char> exposed;   // per node added here: another lane got it from gateTable
+    long long replayReused = 0;
+    for (size_t i = 0; i < n; ++i) {
+        size_t l = laneOf[i];
+        Lane& lane = lanes[l];
+        const LaneMark& from = lane.marks[cursor[l]];
+        const LaneMark& to = lane.marks[++cursor[l]];
+        bool loops = to.loopRegions > from.loopRegions && !summarizing;
+        std::vector<int> at;   // where each of the statement's nodes landed
+        bool clash = false;
+        for (int k = from.nodes; k < to.nodes && !clash; ++k) {
+            if (loops) at.push_back(static_cast<int>(cx.bitMapping.size()));
+            Bit b = lane.cx.bitMapping[k];
+            if (!isGate(b.op)) {
+                lane.image[k] = newBit(cx, b.op);
+                fresh[l][k] = 1;
+                exposed.push_back(0);
+                continue;
+            }
+            bool unary = b.op == Op::Not;
+            int lhs = lane.image[b.lhs];
+            int rhs = unary ? -1 : lane.image[b.rhs];
+            GateKey key{b.op, unary ? lhs : std::min(lhs, rhs), unary ? rhs : std::max(lhs, rhs)};
+            // Only this lane can have asked for a gate over a node it added
+            // that no other lane has reached, and it asked once.
+            auto own = [&](int local) { return fresh[l][local] && !exposed[lane.image[local] - mark]; };
+            if (!own(b.lhs) && (unary || !own(b.rhs))) {
+                auto it = cx.gateTable.find(key);
+                if (it != cx.gateTable.end()) {
+                    clash = !taken[l].insert(it->second).second;
+                    lane.image[k] = it->second;
+                    if (it->second >= mark) exposed[it->second - mark] = 1;
+                    ++replayReused;
                     continue;
                 }
-                else throw std::runtime_error("Index target container not a variable");
             }
+            lane.image[k] = newBit(cx, b.op, lhs, rhs);
+            cx.gateTable.emplace(key, lane.image[k]);
+            fresh[l][k] = 1;
+            exposed.push_back(0);
+        }
+        if (clash) {
+            discardNodes(cx, mark);
+            cx.wordOps.resize(wordMark);
+            cx.tableOps.resize(tableMark);
+            cx.fieldOps.resize(fieldMark);
+            cx.loopRegions.resize(loopMark);
+            return runHere();
+        }
+        if (loops) at.push_back(static_cast<int>(cx.bitMapping.size()));
 
-            else throw std::runtime_error("Unsupported LHS in assignment");
+        const CompilationContext& w = lane.cx;
+        for (size_t k = from.wordOps; k < to.wordOps; ++k) {
+            const WordOp& op = w.wordOps[k];
+            cx.wordOps.push_back(WordOp{op.kind, remap(lane.image, op.lhs), remap(lane.image, op.rhs),
+                                        remap(lane.image, op.sum)});
+        }
+        for (size_t k = from.tableOps; k < to.tableOps; ++k) {
+            const TableOp& op = w.tableOps[k];
+            cx.tableOps.push_back(TableOp{op.table, remap(lane.image, op.in), remap(lane.image, op.out)});
+        }
+        for (size_t k = from.fieldOps; k < to.fieldOps; ++k) {
+            const FieldOp& op = w.fieldOps[k];
+            cx.fieldOps.push_back(FieldOp{op.field, remap(lane.image, op.lhs), remap(lane.image, op.rhs),
+                                          remap(lane.image, op.out)});
+        }
+        for (size_t k = from.loopRegions; loops && k < to.loopRegions; ++k) {
+            LoopRegion region = w.loopRegions[k];
+            region.firstNode = at[region.firstNode - from.nodes];
+            region.endNode = at[region.endNode - from.nodes];
+            region.entry = remap(lane.image, region.entry);
+            region.exit = remap(lane.image, region.exit);
+            cx.loopRegions.push_back(std::move(region));
         }
+    }
 
-        if (auto ret = dynamic_cast<ReturnStmt*>(stmt.get())) {
-            return processPrimitive(ret->value.get());
+    for (auto& v : lastWriter) {
+        const Lane& lane = lanes[laneOf[v.second]];
+        cx.varMapping[v.first] = remap(lane.image, lane.cx.varMapping.at(v.first));
+    }
+    for (Lane& lane : lanes) {
+        cx.gateStats.requested += lane.cx.gateStats.requested;
+        cx.gateStats.reused += lane.cx.gateStats.reused;
+        cx.gateStats.folded += lane.cx.gateStats.folded;
+        for (auto& entry : lane.cx.summaryCache) {
+            auto& cached = cx.summaryCache[entry.first];
+            for (FunctionSummary& summary : entry.second) {
+                bool dup = std::any_of(cached.begin(), cached.end(),
+                                       [&](const FunctionSummary& s) { return sameShape(s, summary); });
+                if (!dup) cached.push_back(std::move(summary));
+            }
         }
     }
-    return {};
+    cx.gateStats.reused += replayReused;
+    return end;
 }
 
-std::vector<int> SemanticAnalyzer::analyze(Program* root) {
-    funcMapping.clear();
-    for (auto &decl : root->decls) {
-        if (auto f = dynamic_cast<FuncDecl*>(decl.get())) 
-            funcMapping[f->name] = f;
+// Uses a summary of function for this argument width, building one the first
+// time. A summary only applies while the caller's free variables still have
+// the widths it was built with. Anything the summary builder rejects, such as
+// a body that throws, is simply inlined as before.
+std::vector<int> SemanticAnalyzer::callFunction(FuncDecl& function, std::vector<int>& arg) {
+    if (cx.sharedSummaries) {
+        auto shared = cx.sharedSummaries->find(&function);
+        if (shared != cx.sharedSummaries->end())
+            for (const FunctionSummary& summary : shared->second)
+                if (summaryApplies(cx, summary, static_cast<int>(arg.size()))) return instantiateSummary(summary, arg);
+    }
+    auto& summaries = cx.summaryCache[&function];
+    for (const FunctionSummary& summary : summaries)
+        if (summaryApplies(cx, summary, static_cast<int>(arg.size()))) return instantiateSummary(summary, arg);
+
+    if (cx.summariesInProgress.count(&function)) return processFunction(function, arg);
+    try {
+        summaries.push_back(buildSummary(function, static_cast<int>(arg.size())));
+    } catch (const std::runtime_error&) {
+        return processFunction(function, arg);
+    }
+    return instantiateSummary(summaries.back(), arg);
+}
+
+// Builds the table's circuit over the index bits and records the lookup in
+// tableOps.
+std::vector<int> SemanticAnalyzer::lookupTable(const TableDecl& table, const std::vector<int>& index) {
+    if (static_cast<int>(index.size()) != table.inBits)
+        throw std::runtime_error("Table " + table.name + " takes " + std::to_string(table.inBits) +
+                                 " bits, got " + std::to_string(index.size()));
+
+    size_t count = size_t{1} << table.inBits;
+    TableCircuit circuit(cx, index);
+    TableOp op{&table, index, {}};
+    for (int j = 0; j < table.outBits; ++j) {
+        int shift = table.outBits - 1 - j;
+        std::string tt(count, '0');
+        for (size_t e = 0; e < count; ++e)
+            if ((table.entries[e] >> shift) & 1) tt[e] = '1';
+        op.out.push_back(circuit.build(tt, 0));
+    }
+    cx.tableOps.push_back(op);
+    return op.out;
+}
+
+// Builds the schoolbook product of a and b, then folds each coefficient of
+// x^k for k >= n back onto x^(k-n) * r, highest first, and records the
+// multiply in fieldOps.
+std::vector<int> SemanticAnalyzer::multiplyField(const FieldDecl& field, const std::vector<int>& a,
+                                                 const std::vector<int>& b) {
+    int n = field.bits;
+    if (static_cast<int>(a.size()) != n || static_cast<int>(b.size()) != n)
+        throw std::runtime_error("Field " + field.name + " multiplies " + std::to_string(n) + "-bit elements, got " +
+                                 std::to_string(a.size()) + " and " + std::to_string(b.size()) + " bits");
+
+    // p[k] is the coefficient of x^k; a[n - 1 - i] is that of x^i.
+    std::vector<int> p(2 * n - 1, 0);
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j)
+            p[i + j] = xorBit(cx, p[i + j], foldGate(cx, Op::And, a[n - 1 - i], b[n - 1 - j]));
+    for (int k = 2 * n - 2; k >= n; --k)
+        for (int t = 0; t < n && t < 64; ++t)
+            if ((field.poly >> t) & 1) p[k - n + t] = xorBit(cx, p[k - n + t], p[k]);
+
+    FieldOp op{&field, a, b, std::vector<int>(n)};
+    for (int i = 0; i < n; ++i) op.out[i] = p[n - 1 - i];
+    cx.fieldOps.push_back(op);
+    return op.out;
+}
+
+FunctionSummary SemanticAnalyzer::buildSummary(FuncDecl& function, int argWidth) {
+    cx.summariesInProgress.insert(&function);
+    try {
+        FunctionSummary summary = summarizeBody(cx, argWidth, [&](std::vector<int>& params) {
+            return processFunction(function, params);
+        });
+        cx.summariesInProgress.erase(&function);
+        return summary;
+    } catch (...) {
+        cx.summariesInProgress.erase(&function);
+        throw;
+    }
+}
+
+// Runs a repeat body once per iteration by instantiating a kernel built from
+// the body, so 80 rounds cost one walk of the AST rather than 80. When every
+// iteration used the same kernel and nothing is being summarized around us,
+// the loop is recorded in loopRegions for the code generators.
+void SemanticAnalyzer::processRepeat(RepeatStmt& loop) {
+    int count = loop.count;
+
+    auto runBody = [&](std::vector<int>&) {
+        std::vector<int> unused;
+        if (processBlock(loop.body, unused)) throw std::runtime_error("return is not allowed inside repeat");
+        return std::vector<int>{};
+    };
+
+    int firstNode = static_cast<int>(cx.bitMapping.size());
+    std::vector<FunctionSummary> kernels;
+    int first = -1;
+    bool uniform = true;
+    std::vector<int> entry;
+    std::vector<int> none;
+    for (int iter = 0; iter < count; ++iter) {
+        int k = 0;
+        while (k < static_cast<int>(kernels.size()) && !summaryApplies(cx, kernels[k], 0)) ++k;
+        if (k == static_cast<int>(kernels.size())) {
+            try {
+                kernels.push_back(summarizeBody(cx, 0, runBody));
+            } catch (const std::runtime_error&) {
+                runBody(none);
+                uniform = false;
+                continue;
+            }
+        }
+        if (iter == 0) {
+            first = k;
+            for (auto& v : kernels[k].vars) {
+                std::vector<int>* cur = findVar(cx, v.first);
+                bool free = std::any_of(kernels[k].freeVars.begin(), kernels[k].freeVars.end(),
+                                        [&](const std::pair<std::string, int>& fv) { return fv.first == v.first && fv.second >= 0; });
+                if (free && cur) entry.insert(entry.end(), cur->begin(), cur->end());
+                else entry.insert(entry.end(), v.second.size(), 0);
+            }
+        }
+        if (k != first) uniform = false;
+        instantiateSummary(kernels[k], none);
+    }
+
+    if (!uniform || count < 2 || !cx.summaryFrames.empty()) return;
+
+    // State bit layout follows kernel.vars; each symbol reads the state bits
+    // of the free variable it stands for.
+    const FunctionSummary& kernel = kernels[first];
+    LoopRegion region;
+    region.count = count;
+    region.firstNode = firstNode;
+    region.endNode = static_cast<int>(cx.bitMapping.size());
+    region.entry = entry;
+    std::unordered_map<std::string, int> base;
+    int width = 0;
+    for (auto& v : kernel.vars) {
+        base[v.first] = width;
+        width += static_cast<int>(v.second.size());
+        std::vector<int>* cur = findVar(cx, v.first);
+        if (!cur || cur->size() != v.second.size()) return;
+        region.exit.insert(region.exit.end(), cur->begin(), cur->end());
+    }
+    for (auto& fv : kernel.freeVars) {
+        if (fv.second < 0) continue;
+        auto it = base.find(fv.first);
+        for (int b = 0; b < fv.second; ++b) region.stateOfSymbol.push_back(it->second + b);
+    }
+    region.kernel = kernel;
+    cx.loopRegions.push_back(std::move(region));
+}
+
+std::vector<int> SemanticAnalyzer::instantiateSummary(const FunctionSummary& summary, const std::vector<int>& arg) {
+    std::vector<int> symbols(arg);
+    for (auto& fv : summary.freeVars) {
+        if (fv.second < 0) continue;
+        std::vector<int>* v = findVar(cx, fv.first);
+        symbols.insert(symbols.end(), v->begin(), v->end());
+    }
+
+    std::vector<int> local(summary.nodes.size());
+    auto resolve = [&](int enc) { return enc >= 2 ? local[enc - 2] : enc < 0 ? symbols[-enc - 1] : enc; };
+    for (size_t k = 0; k < summary.nodes.size(); ++k) {
+        const Bit& b = summary.nodes[k];
+        if (!isGate(b.op)) local[k] = newBit(cx, b.op);
+        else local[k] = foldGate(cx, b.op, resolve(b.lhs), b.op == Op::Not ? -1 : resolve(b.rhs));
+    }
 
-        else throw std::runtime_error("Invalid top-level declaration");
+    // The callee's variables are global, so they are visible to the caller
+    // afterwards exactly as if the body had been inlined.
+    for (auto& v : summary.vars) {
+        std::vector<int>& dst = cx.varMapping[v.first];
+        dst.clear();
+        for (int enc : v.second) dst.push_back(resolve(enc));
+    }
+    for (const WordOp& op : summary.wordOps) {
+        WordOp inst{op.kind, {}, {}, {}};
+        for (int enc : op.lhs) inst.lhs.push_back(resolve(enc));
+        for (int enc : op.rhs) inst.rhs.push_back(resolve(enc));
+        for (int enc : op.sum) inst.sum.push_back(resolve(enc));
+        cx.wordOps.push_back(std::move(inst));
     }
+    for (const TableOp& op : summary.tableOps) {
+        TableOp inst{op.table, {}, {}};
+        for (int enc : op.in) inst.in.push_back(resolve(enc));
+        for (int enc : op.out) inst.out.push_back(resolve(enc));
+        cx.tableOps.push_back(std::move(inst));
+    }
+    for (const FieldOp& op : summary.fieldOps) {
+        FieldOp inst{op.field, {}, {}, {}};
+        for (int enc : op.lhs) inst.lhs.push_back(resolve(enc));
+        for (int enc : op.rhs) inst.rhs.push_back(resolve(enc));
+        for (int enc : op.out) inst.out.push_back(resolve(enc));
+        cx.fieldOps.push_back(std::move(inst));
+    }
+    std::vector<int> ret;
+    ret.reserve(summary.ret.size());
+    for (int enc : summary.ret) ret.push_back(resolve(enc));
+    return ret;
+}
+
+SemanticAnalyzer::SemanticAnalyzer() : owned(std::make_unique<CompilationContext>()), cx(*owned) {}
 
-    auto it = funcMapping.find("main");
-    if (it == funcMapping.end()) throw std::runtime_error("No 'main' function defined");
+SemanticAnalyzer::SemanticAnalyzer(CompilationContext& cx) : cx(cx) {}
+
+SemanticAnalyzer::~SemanticAnalyzer() = default;
+
+std::vector<int> SemanticAnalyzer::analyze(Program* root) {
+    cx.funcMapping.clear();
+    cx.tableMapping.clear();
+    cx.fieldMapping.clear();
+    for (Decl* decl : root->decls) {
+        switch (decl->kind) {
+        case DeclKind::Func: {
+            auto f = static_cast<FuncDecl*>(decl);
+            cx.funcMapping[f->name] = f;
+            break;
+        }
+        case DeclKind::Table: {
+            auto t = static_cast<TableDecl*>(decl);
+            cx.tableMapping[t->name] = t;
+            break;
+        }
+        case DeclKind::Field: {
+            auto f = static_cast<FieldDecl*>(decl);
+            cx.fieldMapping[f->name] = f;
+            break;
+        }
+        }
+    }
+    for (auto& t : cx.tableMapping)
+        if (cx.funcMapping.count(t.first)) throw std::runtime_error("Table and function share the name " + t.first);
+    for (auto& f : cx.fieldMapping)
+        if (cx.funcMapping.count(f.first) || cx.tableMapping.count(f.first))
+            throw std::runtime_error("Field " + f.first + " shares its name with a function or table");
+
+    auto it = cx.funcMapping.find("main");
+    if (it == cx.funcMapping.end()) throw std::runtime_error("No 'main' function defined");
     FuncDecl &mainFunc = *(it->second);
 
-    std::string argcStr = mainFunc.argc;
-    if (argcStr == "-1") throw std::runtime_error("No valid argc for main()");
-    int argc = 0;
-    try { argc = std::stoi(argcStr); }
-    catch (...) { throw std::runtime_error("Invalid argc: not a number"); }
+    int argc = mainFunc.argc;
+    if (argc == -1) throw std::runtime_error("No valid argc for main()");
     if (argc <= 0) throw std::runtime_error("Invalid argc: must be > 0");
 
-    bitMapping.clear();
-    for (int i = 0; i < argc + 2; ++i) {
-        Bit b;
-        b.lhs = b.rhs = -1;
-        b.op = "";
-        if (i == 0) b.value = false;
-        else if (i == 1) b.value = true;
-        else b.value = false;
-        bitMapping[nextBitIndex++] = b;
-    }
+    cx.varMapping.clear();
+    cx.bitMapping.clear();
+    cx.gateTable.clear();
+    cx.gateStats = GateStats{};
+    cx.summaryCache.clear();
+    cx.loopRegions.clear();
+    cx.wordOps.clear();
+    cx.tableOps.clear();
+    cx.fieldOps.clear();
+    cx.summaryFrames.clear();
+    cx.summariesInProgress.clear();
+    cx.varUse.clear();
+    cx.nextSymbol = -2;
+    cx.bitMapping.reserve(argc + 2);
+    newBit(cx, Op::Const0);
+    newBit(cx, Op::Const1);
+    for (int i = 0; i < argc; ++i) newBit(cx, Op::Input);
 
     std::vector<int> inputIndices;
     for (int i = 2; i < argc + 2; ++i) inputIndices.push_back(i);
 
 
     std::vector<int> result = processFunction(mainFunc, inputIndices);
-    // printDebug();
+    // printDebug(cx);
     // for(auto id : result){
     //     std::cout << id << "\n";
     // }
@@ -381,58 +1367,13 @@ std::vector<int> SemanticAnalyzer::analyze(Program* root) {
 }
 
 
-std::string SemanticAnalyzer::cGen(const std::string& name, std::vector<int> out) {
-    auto it = funcMapping.find("main");
-    if (it == funcMapping.end()) throw std::runtime_error("No 'main' function defined");
+int SemanticAnalyzer::mainArgc() {
+    auto it = cx.funcMapping.find("main");
+    if (it == cx.funcMapping.end()) throw std::runtime_error("No 'main' function defined");
     FuncDecl &mainFunc = *(it->second);
 
-    std::string argcStr = mainFunc.argc;
-    if (argcStr == "-1") throw std::runtime_error("No valid argc for main()");
-    int argc = 0;
-    try { argc = std::stoi(argcStr); }
-    catch (...) { throw std::runtime_error("Invalid argc: not a number"); }
+    int argc = mainFunc.argc;
+    if (argc == -1) throw std::runtime_error("No valid argc for main()");
     if (argc <= 0) throw std::runtime_error("Invalid argc: must be > 0");
-
-    int inpBits =argc;
-    int inpBytes = (inpBits + 7) / 8;
-    std::string code = "char* " + name + "(char* input) {\n";
-    int outBytes = (out.size() + 7) / 8;
-    code += "    static char output[" + std::to_string(outBytes) + "] = {0};\n";
-    code += "    for (int i = 0; i < "+ std::to_string(outBytes) +"; i++) output[i] = 0;\n";
-
-    for (size_t i = 0; i < out.size(); ++i) {
-        int idx = out[i] - 2;
-        std::string bitExpr;
-
-        if (idx < 0) {
-            bitExpr = (idx == -2) ? "(0)" : "(1)";
-            if(idx == -2) continue;
-        }
-        else if (idx < inpBits) {
-            bitExpr = "((input[" + std::to_string(idx / 8) + "] >> " 
-                     + std::to_string(7 - (idx % 8)) + ") & 1)";
-        }
-        else {
-            auto b = bitMapping[idx + 2];
-            auto lhsInd = b.lhs - 2;
-            auto bitExpr1 = "((input[" + std::to_string(lhsInd / 8) + "] >> " 
-                           + std::to_string(7 - (lhsInd % 8)) + ") & 1)";
-            if (b.op == "~") {
-                bitExpr = "(~" + bitExpr1 + " & 1)";
-            } else {
-                auto rhsInd = b.rhs - 2;
-                auto bitExpr2 = "((input[" + std::to_string(rhsInd / 8) + "] >> " 
-                               + std::to_string(7 - (rhsInd % 8)) + ") & 1)";
-                bitExpr = "((" + bitExpr1 + " " + b.op + " " + bitExpr2 + ") & 1)";
-            }
-        }
-
-
-        code += "    output[" + std::to_string(i / 8) + "] |= (" + bitExpr + " << " + std::to_string((7-(i%8))) + ");\n";
-    }
-
-    code += "\n    return output;\n";
-    code += "}\n";
-
-    return code;
+    return argc;
 }
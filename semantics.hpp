@@ -2,27 +2,205 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <memory>
+#include <cstdint>
 #include "ast.hpp"
 
+// Node kinds in bitMapping. Index 0 is Const0, index 1 is Const1 and the
+// next argc indices are the Input bits of main; everything after that is a
+// gate or an Undef placeholder for a bit that was never assigned.
+enum class Op : uint8_t { Const0, Const1, Input, Undef, And, Or, Xor, Not };
+
 struct Bit {
-    bool value;
+    int32_t lhs;
+    int32_t rhs;
+    Op op;
+};
+static_assert(sizeof(Bit) <= 12, "gate nodes must stay packed");
+
+inline bool isGate(Op op) { return op >= Op::And; }
+
+inline const char* opSymbol(Op op) {
+    switch (op) {
+        case Op::And: return "&";
+        case Op::Or:  return "|";
+        case Op::Xor: return "^";
+        case Op::Not: return "~";
+        default:      return "";
+    }
+}
+
+struct GateKey {
+    Op op;
     int lhs;
     int rhs;
-    std::string op;
+    bool operator==(const GateKey& o) const { return op == o.op && lhs == o.lhs && rhs == o.rhs; }
+};
+
+struct GateKeyHash {
+    size_t operator()(const GateKey& k) const {
+        size_t h = static_cast<size_t>(k.op);
+        h = h * 1000003u ^ static_cast<size_t>(k.lhs);
+        h = h * 1000003u ^ static_cast<size_t>(k.rhs);
+        return h;
+    }
+};
+
+// Gate requests made while building bitMapping and how many of them were
+// answered with an existing gate.
+struct GateStats {
+    long long requested = 0;
+    long long reused = 0;
+    long long folded = 0;   // requests answered by a constant or an operand
+    double dedupRate() const { return requested ? static_cast<double>(reused) / requested : 0.0; }
+};
+
+enum class WordOpKind : uint8_t { Add, Sub };
+
+// A modular add or subtract of two equal-width vectors. Its ripple-carry
+// gates are in bitMapping like any others, but a word backend may compute sum
+// with one native instruction instead. All three are MSB-first; a sum bit of
+// -1 is no longer computed by anything.
+struct WordOp {
+    WordOpKind kind;
+    std::vector<int> lhs;
+    std::vector<int> rhs;
+    std::vector<int> sum;
+};
+
+// A lookup in a table declaration: in is the index, MSB-first, and out the
+// entry's bits. The gates computing out from in are in bitMapping, but a
+// scalar backend may read the entry from an array instead. An out bit of -1
+// is no longer computed by anything.
+struct TableOp {
+    const TableDecl* table;
+    std::vector<int> in;
+    std::vector<int> out;
+};
+
+// A multiply in a field declaration, all MSB-first. The shift-and-add
+// circuit computing out is in bitMapping, but a scalar backend may use a
+// carry-less multiply instead. An out bit of -1 is no longer computed by
+// anything.
+struct FieldOp {
+    const FieldDecl* field;
+    std::vector<int> lhs;
+    std::vector<int> rhs;
+    std::vector<int> out;
 };
 
+// A function body analyzed once against symbolic argument bits, replayed at
+// each call site by substituting the caller's bits. In nodes, ret and vars an
+// operand of 0 or 1 is a constant, k + 2 refers to nodes[k] and -(k + 1) to
+// symbol k: the argument bits followed by the bits of each free variable.
+struct FunctionSummary {
+    int argWidth = 0;
+    std::vector<std::pair<std::string, int>> freeVars;   // width read from the caller, -1 if it had none
+    std::vector<Bit> nodes;
+    std::vector<int> ret;
+    std::vector<std::pair<std::string, std::vector<int>>> vars;
+    std::vector<WordOp> wordOps;
+    std::vector<TableOp> tableOps;
+    std::vector<FieldOp> fieldOps;
+};
+
+// A repeat loop whose iterations all instantiated the same kernel. Its gates
+// are unrolled into bitMapping like any others, but a code generator may
+// instead run the kernel count times over a state vector laid out as
+// kernel.vars, starting from entry. Nodes in [firstNode, endNode) were built
+// by the loop; exit holds the state after the last iteration.
+struct LoopRegion {
+    int count = 0;
+    FunctionSummary kernel;
+    std::vector<int> stateOfSymbol;   // state bit read by kernel symbol k
+    std::vector<int> entry;
+    std::vector<int> exit;
+    int firstNode = 0;
+    int endNode = 0;
+};
+
+// While a function summary is being built its body runs against an empty
+// varMapping and the caller's variables are parked in a frame. Bits that come
+// from outside the body (the argument and any caller variable it reads) are
+// symbols: negative indices starting at -2, since -1 already marks a missing
+// bit on assignment.
+struct SummaryFrame {
+    std::unordered_map<std::string, std::vector<int>> callerVars;
+    std::vector<std::pair<std::string, int>> freeVars;
+    std::vector<int> freeSymbols;
+};
+
+// The variables some code reads before assigning them and the ones it
+// assigns, worked out from the AST alone. A call counts whatever the callee
+// reads and assigns, its parameter included.
+struct VarUse {
+    std::unordered_set<std::string> reads;
+    std::unordered_set<std::string> writes;
+    std::unordered_set<std::string> lookups;   // looked up but not needed, such as a loop's entry state
+    bool calls = false;    // calls a function, table or field, or loops
+    bool opaque = false;   // recursion or anything else the walk cannot follow
+};
+
+// Everything one compilation builds and reads. Contexts share nothing, so
+// separate programs compile on separate threads as long as each has its own.
+// The Program whose declarations funcMapping and friends point into must
+// outlive the context's use.
+struct CompilationContext {
+    std::unordered_map<std::string, std::vector<int>> varMapping;
+    std::unordered_map<std::string, FuncDecl*> funcMapping;
+    std::unordered_map<std::string, TableDecl*> tableMapping;
+    std::unordered_map<std::string, FieldDecl*> fieldMapping;
+    std::vector<Bit> bitMapping;
+    std::unordered_map<GateKey, int, GateKeyHash> gateTable;
+    GateStats gateStats;
+    std::unordered_map<const FuncDecl*, std::vector<FunctionSummary>> summaryCache;
+    std::vector<LoopRegion> loopRegions;
+    std::vector<WordOp> wordOps;
+    std::vector<TableOp> tableOps;
+    std::vector<FieldOp> fieldOps;
+    std::vector<SummaryFrame> summaryFrames;
+    std::unordered_set<const FuncDecl*> summariesInProgress;
+    int nextSymbol = -2;
+    unsigned analysisThreads = 0;   // threads for independent statements, 0 for one per hardware thread
+    std::unordered_map<const FuncDecl*, VarUse> varUse;
+    // Summaries a worker context may use but not change: its parent's cache.
+    const std::unordered_map<const FuncDecl*, std::vector<FunctionSummary>>* sharedSummaries = nullptr;
+};
+
+class LanePool;
+
+// Analyzes into the context it was given, or into one of its own. Every
+// method reads and writes only that context.
 class SemanticAnalyzer {
 public:
+    SemanticAnalyzer();
+    explicit SemanticAnalyzer(CompilationContext& cx);
+    ~SemanticAnalyzer();
+
+    CompilationContext& context() { return cx; }
+
     std::vector<int> analyze(Program* root);
     std::vector<int> processPrimitive(Expr* expr);
     std::vector<int> processFunction(FuncDecl& function, std::vector<int>& inputIndices);
-    std::string cGen(const std::string& name, std::vector<int> out);
-};
+    bool processBlock(const AstList<Stmt>& body, std::vector<int>& result);
+    bool processStmt(Stmt* stmt, std::vector<int>& result);
+    size_t processLanes(const AstList<Stmt>& body, size_t begin, unsigned threads);
+    void processRepeat(RepeatStmt& loop);
+    std::vector<int> callFunction(FuncDecl& function, std::vector<int>& arg);
+    std::vector<int> lookupTable(const TableDecl& table, const std::vector<int>& index);
+    std::vector<int> multiplyField(const FieldDecl& field, const std::vector<int>& a, const std::vector<int>& b);
+    FunctionSummary buildSummary(FuncDecl& function, int argWidth);
+    std::vector<int> instantiateSummary(const FunctionSummary& summary, const std::vector<int>& arg);
+    std::string cGen(const std::string& name, std::vector<int> out, bool unrollLoops = false);
+    std::string cGenWord(const std::string& name, const std::vector<int>& out);
+    std::string cGenBitsliced(const std::string& name, const std::vector<int>& out);
+    int mainArgc();
 
-extern std::unordered_map<std::string, std::vector<int>> varMapping;
-extern std::unordered_map<std::string, FuncDecl*> funcMapping;
-extern std::unordered_map<int, Bit> bitMapping;
-extern int nextBitIndex;
+private:
+    std::unique_ptr<CompilationContext> owned;
+    CompilationContext& cx;
+    std::unique_ptr<LanePool> lanePool;   // started by the first run of lanes
+};
 
-void printDebug();
+void printDebug(const CompilationContext& cx);
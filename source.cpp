@@ -0,0 +1,47 @@
+#include "source.hpp"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define BITSMITH_MMAP 1
+#endif
+
+SourceFile::SourceFile(const std::string& path) {
+#ifdef BITSMITH_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Cannot open " + path);
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Cannot stat " + path);
+    }
+    size = static_cast<size_t>(st.st_size);
+    if (size > 0) {
+        void* p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            data = static_cast<const char*>(p);
+            mapped = true;
+        }
+    }
+    ::close(fd);
+    if (mapped || size == 0) return;
+#endif
+    std::ifstream file(path, std::ios::binary);
+    if (!file) throw std::runtime_error("Cannot open " + path);
+    std::stringstream ss;
+    ss << file.rdbuf();
+    buffer = ss.str();
+    data = buffer.data();
+    size = buffer.size();
+}
+
+SourceFile::~SourceFile() {
+#ifdef BITSMITH_MMAP
+    if (mapped) ::munmap(const_cast<char*>(data), size);
+#endif
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only view of a whole source file. On POSIX hosts the file is mapped
+// rather than read, so the preprocessor scans it in place; elsewhere it is
+// read into memory once.
+class SourceFile {
+public:
+    explicit SourceFile(const std::string& path);
+    ~SourceFile();
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    std::string_view text() const { return std::string_view(data, size); }
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    std::string buffer;
+};